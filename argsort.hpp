@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <variant>
+#include <vector>
+
+#include "timsort.hpp"
+
+namespace my {
+
+    // Orders positions by the elements they refer to.
+    template<class Iter, class Cmp>
+    struct indirect_cmp {
+        Iter first;
+        Cmp cmp;
+
+        template<class Index>
+        bool operator()(Index left, Index right) const {
+            return cmp(first[left], first[right]);
+        }
+    };
+
+    // The stable sorting permutation of [first, last) as Index values:
+    // first[result[0]], first[result[1]], ... is sorted and equal elements
+    // keep their input order. The data itself is only read. Long inputs
+    // merge on `pool` like any other timsort.
+    template<class Index, class Iter,
+            class Cmp = std::less<typename std::iterator_traits<Iter>::value_type>>
+    std::vector<Index> argsort(Iter first, Iter last, Cmp cmp = {},
+                               thread_pool &pool = thread_pool::instance()) {
+        static_assert(std::is_unsigned<Index>::value, "argsort indices are unsigned integers");
+        ptrdiff_t len = last - first;
+        if ((uint64_t) len > std::numeric_limits<Index>::max()) {
+            throw std::length_error("argsort: index type too narrow");
+        }
+        std::vector<Index> index(len);
+        for (ptrdiff_t n = 0; n < len; ++n) {
+            index[n] = Index(n);
+        }
+        timsort<Index *, indirect_cmp<Iter, Cmp>> tim(pool);
+        tim.sort(index.data(), index.data() + len, {first, cmp});
+        return index;
+    }
+
+    using argsort_result = std::variant<std::vector<uint32_t>, std::vector<uint64_t>>;
+
+    // As above with the narrowest index type that can address the range:
+    // 32-bit indices below 2^32 elements halve the memory the merges move.
+    template<class Iter,
+            class Cmp = std::less<typename std::iterator_traits<Iter>::value_type>>
+    argsort_result argsort(Iter first, Iter last, Cmp cmp = {},
+                           thread_pool &pool = thread_pool::instance()) {
+        if ((uint64_t) (last - first) <= std::numeric_limits<uint32_t>::max()) {
+            return argsort<uint32_t>(first, last, cmp, pool);
+        }
+        return argsort<uint64_t>(first, last, cmp, pool);
+    }
+
+} // namespace my
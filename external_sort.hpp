@@ -0,0 +1,517 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "thread_pool.hpp"
+#include "timsort.hpp"
+
+namespace my {
+
+    // Smallest block a run is streamed in during the merge. Below this the
+    // merge degrades into random I/O, so the fan-in is capped instead.
+    size_t const EXTERNAL_BLOCK_BYTES = 1 << 20;
+
+    // Owns a POSIX file descriptor. Every failure throws std::system_error.
+    class file {
+        int fd{-1};
+
+        [[noreturn]] static void fail(char const *what) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+
+    public:
+        file() = default;
+
+        file(std::string const &path, int flags, mode_t mode = 0644) : fd(::open(path.c_str(), flags, mode)) {
+            if (fd < 0) {
+                fail(path.c_str());
+            }
+        }
+
+        // An unnamed file in `dir`; its data goes away with the descriptor.
+        static file temporary(std::string const &dir) {
+            std::string path = dir + "/timsort-XXXXXX";
+            file ret;
+            ret.fd = ::mkstemp(&path[0]);
+            if (ret.fd < 0) {
+                fail(path.c_str());
+            }
+            ::unlink(path.c_str());
+            return ret;
+        }
+
+        file(file &&other) noexcept : fd(other.fd) {
+            other.fd = -1;
+        }
+
+        file &operator=(file &&other) noexcept {
+            std::swap(fd, other.fd);
+            return *this;
+        }
+
+        ~file() {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+
+        int get() const {
+            return fd;
+        }
+
+        size_t size() const {
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                fail("fstat");
+            }
+            return size_t(st.st_size);
+        }
+
+        // Whether both descriptors refer to the same file, whatever the
+        // paths they were opened by.
+        bool same_as(file const &other) const {
+            struct stat st, other_st;
+            if (::fstat(fd, &st) != 0 || ::fstat(other.fd, &other_st) != 0) {
+                fail("fstat");
+            }
+            return st.st_dev == other_st.st_dev && st.st_ino == other_st.st_ino;
+        }
+
+        void resize(size_t bytes) const {
+            if (::ftruncate(fd, off_t(bytes)) != 0) {
+                fail("ftruncate");
+            }
+        }
+
+        // Short only at end of file.
+        size_t read(void *buf, size_t bytes, size_t offset) const {
+            size_t done = 0;
+            while (done < bytes) {
+                ssize_t n = ::pread(fd, static_cast<char *>(buf) + done, bytes - done, off_t(offset + done));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    fail("pread");
+                }
+                if (n == 0) {
+                    break;
+                }
+                done += size_t(n);
+            }
+            return done;
+        }
+
+        void write(void const *buf, size_t bytes, size_t offset) const {
+            size_t done = 0;
+            while (done < bytes) {
+                ssize_t n = ::pwrite(fd, static_cast<char const *>(buf) + done, bytes - done, off_t(offset + done));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    fail("pwrite");
+                }
+                done += size_t(n);
+            }
+        }
+    };
+
+    // At most one I/O request in flight on the pool. wait() returns once it
+    // is done and rethrows whatever it threw. A request no thread has
+    // picked up yet is run by wait() itself, so I/O never waits on a free
+    // worker (there may be none, or they may all be waiting on I/O).
+    class async_io {
+        my::task request;
+        std::atomic_bool claimed{true};
+        std::exception_ptr error;
+        task_group group;
+
+        // Runs the request unless another thread already has.
+        void serve() {
+            if (claimed.exchange(true)) {
+                return;
+            }
+            try {
+                request();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            request.reset();
+        }
+
+    public:
+        explicit async_io(thread_pool &pool) : group(pool) {
+        }
+
+        template<class F>
+        void start(F fun) {
+            request.emplace(std::move(fun));
+            claimed = false;
+            group.run([this] { serve(); });
+        }
+
+        void wait() {
+            serve();
+            group.wait();
+            if (error) {
+                std::exception_ptr ptr = error;
+                error = nullptr;
+                std::rethrow_exception(ptr);
+            }
+        }
+    };
+
+    // Sorts files of fixed-size binary records that do not fit in memory.
+    // Chunks of the input sized to the budget are sorted with timsort on the
+    // pool, the next chunk being read meanwhile, and spilled as runs to a
+    // temporary file. The runs are then merged k at a time, each one
+    // streamed through two blocks so reads overlap the merge. When there are
+    // too many runs for blocks of EXTERNAL_BLOCK_BYTES, extra merge passes
+    // run first. Equal records keep their input order.
+    template<class Ty, class Cmp = std::less<Ty>>
+    class external_sort {
+        static_assert(std::is_trivially_copyable<Ty>::value, "records are stored as raw bytes");
+
+        // A sorted run as a byte range of a spill file.
+        struct Run {
+            size_t first;
+            size_t last;
+        };
+
+        class run_reader {
+            file const &src;
+            size_t next;
+            size_t end;
+            std::vector<Ty> block[2];
+            size_t ahead{0};
+            Ty const *cur{nullptr};
+            Ty const *last{nullptr};
+            async_io io;
+
+            // Starts reading the next block into block[1].
+            void fetch() {
+                size_t bytes = std::min(block[1].size() * sizeof(Ty), end - next);
+                file const *ptr = &src;
+                Ty *dst = block[1].data();
+                size_t at = next;
+                next += bytes;
+                ahead = bytes / sizeof(Ty);
+                io.start([ptr, dst, bytes, at] { ptr->read(dst, bytes, at); });
+            }
+
+            void refill() {
+                io.wait();
+                std::swap(block[0], block[1]);
+                cur = block[0].data();
+                last = cur + ahead;
+                ahead = 0;
+                if (next < end) {
+                    fetch();
+                }
+            }
+
+        public:
+            run_reader(file const &src, Run run, size_t records, thread_pool &pool)
+                    : src(src), next(run.first), end(run.last), io(pool) {
+                block[0].resize(records);
+                block[1].resize(records);
+                fetch();
+                refill();
+            }
+
+            bool empty() const {
+                return cur == last;
+            }
+
+            Ty const &front() const {
+                return *cur;
+            }
+
+            void pop() {
+                if (++cur == last) {
+                    refill();
+                }
+            }
+        };
+
+        // Writes each full block while the next one fills. The blocks are
+        // only taken by the first push(), so a sink made before the runs
+        // are spilled holds no memory until the merge that feeds it.
+        class file_sink {
+            file const &dst;
+            size_t offset;
+            size_t records;
+            std::vector<Ty> block[2];
+            size_t fill{0};
+            async_io io;
+
+        public:
+            file_sink(file const &dst, size_t offset, size_t records, thread_pool &pool)
+                    : dst(dst), offset(offset), records(records), io(pool) {
+            }
+
+            void push(Ty const &value) {
+                if (fill == block[0].size()) {
+                    if (block[0].empty()) {
+                        block[0].resize(records);
+                        block[1].resize(records);
+                    } else {
+                        flush();
+                    }
+                }
+                block[0][fill++] = value;
+            }
+
+            void append(Ty const *src, size_t len) {
+                finish();
+                dst.write(src, len * sizeof(Ty), offset);
+                offset += len * sizeof(Ty);
+            }
+
+            void flush() {
+                io.wait();
+                std::swap(block[0], block[1]);
+                file const *ptr = &dst;
+                Ty const *src = block[1].data();
+                size_t bytes = fill * sizeof(Ty);
+                size_t at = offset;
+                offset += bytes;
+                fill = 0;
+                if (bytes != 0) {
+                    io.start([ptr, src, bytes, at] { ptr->write(src, bytes, at); });
+                }
+            }
+
+            void finish() {
+                flush();
+                io.wait();
+            }
+        };
+
+        // Output straight into memory, typically a mapping of the output file.
+        struct memory_sink {
+            Ty *out;
+
+            void push(Ty const &value) {
+                *out++ = value;
+            }
+
+            void append(Ty const *src, size_t len) {
+                std::memcpy(out, src, len * sizeof(Ty));
+                out += len;
+            }
+
+            void finish() {
+            }
+        };
+
+        thread_pool &pool;
+        size_t budget;
+        std::string temp_dir = "/tmp";
+        bool mapped_output = false;
+
+    public:
+        // `budget` bounds the bytes of records held in memory at once.
+        explicit external_sort(size_t budget, thread_pool &pool = thread_pool::instance())
+                : pool(pool), budget(budget) {
+        }
+
+        // Where run files are created. They are unlinked as soon as they
+        // are opened.
+        void set_temp_dir(std::string dir) {
+            temp_dir = std::move(dir);
+        }
+
+        // Map the output file and merge straight into it instead of
+        // writing it block by block.
+        void use_mmap_output(bool on) {
+            mapped_output = on;
+        }
+
+        void sort(std::string const &input, std::string const &output, Cmp const cmp = {}) {
+            file in(input, O_RDONLY);
+            size_t bytes = records(in) * sizeof(Ty);
+            // Truncated only once it is known not to be the input.
+            file out(output, O_RDWR | O_CREAT);
+            if (out.same_as(in)) {
+                throw std::invalid_argument("external_sort: output is the input file");
+            }
+            out.resize(0);
+            if (!mapped_output) {
+                file_sink sink(out, 0, block_records(fan_in() + 1), pool);
+                sort(in, sink, cmp);
+                return;
+            }
+            out.resize(bytes);
+            if (bytes == 0) {
+                return;
+            }
+            void *map = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, out.get(), 0);
+            if (map == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category(), "mmap");
+            }
+            try {
+                memory_sink sink{static_cast<Ty *>(map)};
+                sort(in, sink, cmp);
+            } catch (...) {
+                ::munmap(map, bytes);
+                throw;
+            }
+            ::munmap(map, bytes);
+        }
+
+        // Sorts `input` into caller memory holding as many records as the
+        // file, for instance a mapping the caller made of the output.
+        void sort(std::string const &input, Ty *output, Cmp const cmp = {}) {
+            file in(input, O_RDONLY);
+            memory_sink sink{output};
+            sort(in, sink, cmp);
+        }
+
+    private:
+        size_t records(file const &in) const {
+            size_t bytes = in.size();
+            if (bytes % sizeof(Ty) != 0) {
+                throw std::invalid_argument("external_sort: input is not a whole number of records");
+            }
+            return bytes / sizeof(Ty);
+        }
+
+        // Two buffers per stream plus one for the chunk sort's scratch.
+        size_t chunk_records() const {
+            size_t len = budget / (3 * sizeof(Ty));
+            if (len == 0) {
+                throw std::invalid_argument("external_sort: memory budget below three records");
+            }
+            return len;
+        }
+
+        size_t block_records(size_t streams) const {
+            return std::max<size_t>(1, budget / (2 * std::max<size_t>(1, streams)) / sizeof(Ty));
+        }
+
+        // Clamped before the subtraction, which would wrap for a budget
+        // under two blocks.
+        size_t fan_in() const {
+            return std::max<size_t>(3, budget / (2 * EXTERNAL_BLOCK_BYTES)) - 1;
+        }
+
+        template<class Sink>
+        void sort(file const &in, Sink &sink, Cmp const cmp) {
+            size_t len = records(in);
+            size_t chunk = chunk_records();
+            if (len <= chunk) {
+                timsort<Ty *, Cmp> tim(pool);
+                if constexpr (std::is_same<Sink, memory_sink>::value) {
+                    in.read(sink.out, len * sizeof(Ty), 0);
+                    tim.sort(sink.out, sink.out + len, cmp);
+                } else {
+                    std::vector<Ty> buf(len);
+                    in.read(buf.data(), len * sizeof(Ty), 0);
+                    tim.sort(buf.data(), buf.data() + len, cmp);
+                    sink.append(buf.data(), len);
+                }
+                sink.finish();
+                return;
+            }
+            file spill = file::temporary(temp_dir);
+            std::vector<Run> runs = spill_runs(in, len, chunk, spill, cmp);
+            while (runs.size() > fan_in()) {
+                file next = file::temporary(temp_dir);
+                std::vector<Run> merged;
+                size_t offset = 0;
+                for (size_t i = 0; i < runs.size(); i += fan_in()) {
+                    size_t k = std::min(fan_in(), runs.size() - i);
+                    file_sink out(next, offset, block_records(k + 1), pool);
+                    merge(spill, runs.data() + i, k, out, cmp);
+                    merged.push_back({offset, runs[i + k - 1].last - runs[i].first + offset});
+                    offset = merged.back().last;
+                }
+                spill = std::move(next);
+                runs = std::move(merged);
+            }
+            merge(spill, runs.data(), runs.size(), sink, cmp);
+        }
+
+        std::vector<Run> spill_runs(file const &in, size_t len, size_t chunk, file const &spill, Cmp const cmp) {
+            std::vector<Run> runs;
+            std::vector<Ty> cur(chunk);
+            std::vector<Ty> next(chunk);
+            timsort<Ty *, Cmp> tim(pool);
+            async_io io(pool);
+            size_t got = in.read(cur.data(), chunk * sizeof(Ty), 0) / sizeof(Ty);
+            size_t pos = got;
+            size_t offset = 0;
+            while (got != 0) {
+                size_t ahead = std::min(chunk, len - pos);
+                if (ahead != 0) {
+                    file const *ptr = &in;
+                    Ty *dst = next.data();
+                    size_t bytes = ahead * sizeof(Ty);
+                    size_t at = pos * sizeof(Ty);
+                    io.start([ptr, dst, bytes, at] { ptr->read(dst, bytes, at); });
+                }
+                tim.sort(cur.data(), cur.data() + got, cmp);
+                spill.write(cur.data(), got * sizeof(Ty), offset);
+                runs.push_back({offset, offset + got * sizeof(Ty)});
+                offset = runs.back().last;
+                io.wait();
+                std::swap(cur, next);
+                pos += ahead;
+                got = ahead;
+            }
+            return runs;
+        }
+
+        // k-way merge through a binary heap of run indices. Ties go to the
+        // lower index, which holds the earlier part of the input.
+        template<class Sink>
+        void merge(file const &src, Run const *run, size_t k, Sink &sink, Cmp const cmp) {
+            std::vector<std::unique_ptr<run_reader>> in;
+            for (size_t i = 0; i < k; ++i) {
+                in.emplace_back(new run_reader(src, run[i], block_records(k + 1), pool));
+            }
+            auto after = [&](size_t a, size_t b) {
+                Ty const &left = in[a]->front();
+                Ty const &right = in[b]->front();
+                return cmp(right, left) || (!cmp(left, right) && a > b);
+            };
+            std::vector<size_t> heap;
+            for (size_t i = 0; i < k; ++i) {
+                if (!in[i]->empty()) {
+                    heap.push_back(i);
+                }
+            }
+            std::make_heap(heap.begin(), heap.end(), after);
+            while (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), after);
+                size_t i = heap.back();
+                sink.push(in[i]->front());
+                in[i]->pop();
+                if (in[i]->empty()) {
+                    heap.pop_back();
+                } else {
+                    std::push_heap(heap.begin(), heap.end(), after);
+                }
+            }
+            sink.finish();
+        }
+    };
+
+} // namespace my
@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <chrono>
+#include <functional>
 #include <random>
+#include <vector>
 
 #include "print.hpp"
 #include "timsort.hpp"
@@ -44,8 +46,17 @@ void test(Iter first, Iter last, Cmp cmp = {}) {
         std::copy(first, _last, _last + div);
     });
 
+    // Timed without statistics; the counts come from a second, instrumented
+    // run on a copy of the same input.
+    using vector = std::vector<typename std::iterator_traits<Iter>::value_type>;
     my::timsort<Iter, Cmp> tim;
-    auto sort = [&] { Time([&] { tim.sort(first, last, cmp); }); };
+    my::timsort<typename vector::iterator, Cmp, my::sort_stats> counted;
+    auto sort = [&] {
+        vector copy(first, last);
+        Time([&] { tim.sort(first, last, cmp); });
+        counted.sort(copy.begin(), copy.end(), cmp);
+        println("stats:\t", counted.stats().json());
+    };
     // auto sort = [&] { Time([&] { my::merge_sort(first, last, cmp); }); };
 
     println("\nSort random:");
@@ -64,6 +75,30 @@ void test(Iter first, Iter last, Cmp cmp = {}) {
     check(first, last, cmp);
 }
 
+// A/B of the merge policies on sorted runs of skewed lengths, each a
+// random 1/2 to 1/256 of the input. Radix is off so the runs get merged.
+template<class Iter>
+void test_policy(Iter first, Iter last) {
+    ptrdiff_t len = last - first;
+    for (Iter it = first; it < last;) {
+        Iter end = it + std::min(last - it, std::max<ptrdiff_t>(1, len >> (1 + mt_rand() % 8)));
+        std::generate(it, end, std::ref(mt_rand));
+        std::sort(it, end);
+        it = end;
+    }
+    std::vector<typename std::iterator_traits<Iter>::value_type> input(first, last);
+    for (auto policy : {my::merge_policy::classic, my::merge_policy::powersort}) {
+        std::copy(input.begin(), input.end(), first);
+        my::timsort<Iter> tim;
+        tim.use_radix(false);
+        tim.use_merge_policy(policy);
+        println("\nSort skewed runs, ", policy == my::merge_policy::classic ? "classic" : "powersort", ":");
+        Time([&] { tim.sort(first, last); });
+        println("merged:\t", tim.elements_merged());
+        check(first, last);
+    }
+}
+
 int main() {
     size_t len = 5000 * (size_t) 9999;
     std::vector<int> arr;
@@ -72,5 +107,6 @@ int main() {
     while (num--) {
         test(arr.begin(), arr.end(), std::greater<int>{});
     }
+    test_policy(arr.begin(), arr.end());
     return 0;
 }
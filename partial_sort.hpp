@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "run_scan.hpp"
+#include "timsort.hpp"
+
+namespace my {
+
+    // Inputs at least this long are searched in one chunk per thread.
+    ptrdiff_t const PARTIAL_PARALLEL_THRESHOLDS = 1 << 16;
+
+    // Orders positions by (element, position), the order a stable sort
+    // leaves them in; no two positions are equal under it.
+    template<class Iter, class Cmp>
+    struct stable_rank {
+        Iter first;
+        Cmp cmp;
+
+        bool operator()(ptrdiff_t left, ptrdiff_t right) const {
+            if (cmp(first[left], first[right])) {
+                return true;
+            }
+            return !cmp(first[right], first[left]) && left < right;
+        }
+    };
+
+    // The k best positions of [lo, hi) under `rank`, as a max-heap. Where
+    // an element could make the heap, the run starting there is taken
+    // whole: an ascending run is read from its front and dropped at its
+    // first element that misses, since all that follows ranks lower still;
+    // a descending run is read from the back, so it costs k insertions
+    // rather than one per element, and dropped at its first element above
+    // the heap's worst.
+    template<class Iter, class Cmp>
+    std::vector<ptrdiff_t> select_best(Iter first, ptrdiff_t lo, ptrdiff_t hi, size_t k, Cmp cmp) {
+        stable_rank<Iter, Cmp> rank{first, cmp};
+        std::vector<ptrdiff_t> heap;
+        heap.reserve(k);
+        // Whether position n made the heap.
+        auto offer = [&](ptrdiff_t n) {
+            if (heap.size() < k) {
+                heap.push_back(n);
+                std::push_heap(heap.begin(), heap.end(), rank);
+                return true;
+            }
+            if (!rank(n, heap.front())) {
+                return false;
+            }
+            std::pop_heap(heap.begin(), heap.end(), rank);
+            heap.back() = n;
+            std::push_heap(heap.begin(), heap.end(), rank);
+            return true;
+        };
+        Iter last = first + hi;
+        for (Iter it = first + lo; it < last;) {
+            // Everything in the heap comes from before it, so an element no
+            // less than the worst one ranks below it.
+            if (heap.size() == k && !cmp(*it, first[heap.front()])) {
+                ++it;
+                continue;
+            }
+            Iter tmp = it;
+            it = ascending_end(tmp, last, cmp);
+            if (it < last && !cmp(tmp[0], it[-1])) {
+                it = descending_end(it, last, cmp);
+                for (Iter pos = it; pos > tmp; --pos) {
+                    if (!offer(pos - 1 - first) && cmp(first[heap.front()], pos[-1])) {
+                        break;
+                    }
+                }
+            } else {
+                for (Iter pos = tmp; pos < it; ++pos) {
+                    if (!offer(pos - first)) {
+                        break;
+                    }
+                }
+            }
+        }
+        return heap;
+    }
+
+    // Stable partial sort: [first, middle) ends up holding the
+    // middle - first smallest elements in the order a stable sort would
+    // give them, [middle, last) the rest in no particular order. Every
+    // thread keeps a bounded heap of the best positions of its chunk; the
+    // heaps are combined, the winners swapped into the front and put in
+    // order by one permutation, so only O(k) elements move. A large k is
+    // better served by sorting everything.
+    template<class Iter,
+            class Cmp = std::less<typename std::iterator_traits<Iter>::value_type>>
+    void partial_sort(Iter first, Iter middle, Iter last, Cmp cmp = {},
+                      thread_pool &pool = thread_pool::instance()) {
+        using value_type = typename std::iterator_traits<Iter>::value_type;
+        ptrdiff_t len = last - first;
+        ptrdiff_t k = middle - first;
+        if (k <= 0) {
+            return;
+        }
+        if (k * 8 > len) {
+            timsort<Iter, Cmp> tim(pool);
+            tim.sort(first, last, cmp);
+            return;
+        }
+        ptrdiff_t parts = len < PARTIAL_PARALLEL_THRESHOLDS ? 1 : (ptrdiff_t) pool.size() + 1;
+        std::vector<std::vector<ptrdiff_t>> best(parts);
+        parallel_for(pool, parts, [&](ptrdiff_t t) {
+            best[t] = select_best(first, len * t / parts, len * (t + 1) / parts, k, cmp);
+        });
+
+        stable_rank<Iter, Cmp> rank{first, cmp};
+        std::vector<ptrdiff_t> chosen = std::move(best[0]);
+        for (ptrdiff_t t = 1; t < parts; ++t) {
+            chosen.insert(chosen.end(), best[t].begin(), best[t].end());
+        }
+        std::sort(chosen.begin(), chosen.end(), rank);
+        chosen.resize(k);
+
+        // Swap the chosen elements from [middle, last) into the front slots
+        // held by elements that were not chosen, noting for the j-th
+        // smallest which front slot now holds it.
+        std::vector<bool> taken(k);
+        for (ptrdiff_t n : chosen) {
+            if (n < k) {
+                taken[n] = true;
+            }
+        }
+        std::vector<ptrdiff_t> slot(k);
+        ptrdiff_t hole = 0;
+        for (ptrdiff_t j = 0; j < k; ++j) {
+            if (chosen[j] < k) {
+                slot[j] = chosen[j];
+                continue;
+            }
+            while (taken[hole]) {
+                ++hole;
+            }
+            std::iter_swap(first + hole, first + chosen[j]);
+            slot[j] = hole++;
+        }
+
+        // slot[j] is where the element that belongs at j is now.
+        for (ptrdiff_t n = 0; n < k; ++n) {
+            if (slot[n] == n) {
+                continue;
+            }
+            value_type tmp = std::move(first[n]);
+            ptrdiff_t pos = n;
+            while (slot[pos] != n) {
+                ptrdiff_t next = slot[pos];
+                first[pos] = std::move(first[next]);
+                slot[pos] = pos;
+                pos = next;
+            }
+            first[pos] = std::move(tmp);
+            slot[pos] = pos;
+        }
+    }
+
+    // Stable selection: nth ends up holding the element a stable sort would
+    // put there, everything before it sorts no later and everything after
+    // no earlier. The front is left sorted as partial_sort leaves it.
+    template<class Iter,
+            class Cmp = std::less<typename std::iterator_traits<Iter>::value_type>>
+    void nth_element(Iter first, Iter nth, Iter last, Cmp cmp = {},
+                     thread_pool &pool = thread_pool::instance()) {
+        if (nth < last) {
+            partial_sort(first, nth + 1, last, cmp, pool);
+        }
+    }
+
+} // namespace my
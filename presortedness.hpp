@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <vector>
+
+namespace my {
+
+    // Evenly spaced neighbour pairs, random pairs and random elements
+    // looked at by estimate_presortedness.
+    ptrdiff_t const PRESORTEDNESS_SAMPLES = 256;
+
+    // How sorted an input looks, from a few hundred comparisons.
+    struct presortedness {
+        // Comparisons behind each of the measures below; 0 when the input
+        // was too short to be worth estimating.
+        ptrdiff_t samples = 0;
+        // Natural runs, ascending or descending, scaled up from how often
+        // sampled neighbour pairs go against the majority direction.
+        ptrdiff_t runs = 1;
+        // Share of random pairs i < j with a[j] < a[i]: 0 sorted, about
+        // 0.5 random, 1 reversed.
+        double inversions = 0;
+        // Distinct keys among `samples` random elements.
+        ptrdiff_t distinct = 0;
+        // No sampled neighbour pair goes against the other's direction.
+        bool presorted = true;
+    };
+
+    template<class Iter, class Cmp>
+    presortedness estimate_presortedness(Iter first, Iter last, Cmp cmp) {
+        presortedness est;
+        ptrdiff_t len = last - first;
+        if (len < 2) {
+            return est;
+        }
+        ptrdiff_t const n = PRESORTEDNESS_SAMPLES;
+        est.samples = n;
+        ptrdiff_t up = 0;
+        ptrdiff_t down = 0;
+        for (ptrdiff_t s = 0; s < n; ++s) {
+            Iter it = first + (len - 1) * s / n;
+            up += cmp(it[0], it[1]);
+            down += cmp(it[1], it[0]);
+        }
+        est.presorted = up == 0 || down == 0;
+        est.runs = 1 + len * std::min(up, down) / n;
+
+        std::minstd_rand rand{uint32_t(len)};
+        std::uniform_int_distribution<ptrdiff_t> pick(0, len - 1);
+        ptrdiff_t inverted = 0;
+        for (ptrdiff_t s = 0; s < n; ++s) {
+            ptrdiff_t i = pick(rand);
+            ptrdiff_t j = pick(rand);
+            if (i > j) {
+                std::swap(i, j);
+            }
+            inverted += cmp(first[j], first[i]);
+        }
+        est.inversions = double(inverted) / n;
+
+        std::vector<Iter> sample(n);
+        for (Iter &it : sample) {
+            it = first + pick(rand);
+        }
+        std::sort(sample.begin(), sample.end(), [&](Iter a, Iter b) { return cmp(*a, *b); });
+        est.distinct = 1;
+        for (ptrdiff_t s = 1; s < n; ++s) {
+            est.distinct += cmp(*sample[s - 1], *sample[s]);
+        }
+        return est;
+    }
+
+} // namespace my
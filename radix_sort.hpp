@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "type_traits.hpp"
+
+namespace my {
+
+    ptrdiff_t const RADIX_THRESHOLDS = 1 << 12;
+    ptrdiff_t const RADIX_PARALLEL_THRESHOLDS = 1 << 16;
+    // Bytes each bucket stages before it is flushed to the output.
+    size_t const RADIX_COMBINE_BYTES = 64;
+
+    template<size_t Size>
+    using unsigned_of = std::conditional_t<Size == 1, uint8_t,
+            std::conditional_t<Size == 2, uint16_t,
+                    std::conditional_t<Size == 4, uint32_t, uint64_t>>>;
+
+    // Integers and IEEE floats under std::less / std::greater.
+    template<class Ty, class Cmp>
+    constexpr bool use_radix_v = is_standard_order_v<Ty, Cmp>
+                                 && ((std::is_integral<Ty>::value && !std::is_same<Ty, bool>::value)
+                                     || (std::is_floating_point<Ty>::value
+                                         && std::numeric_limits<Ty>::is_iec559
+                                         && (sizeof(Ty) == 4 || sizeof(Ty) == 8)));
+
+    // Maps a key to an unsigned integer that orders the same way under Cmp.
+    // Signed keys flip the sign bit. Negative floats flip every bit and
+    // positive floats flip the sign bit. Descending order inverts the result.
+    // -0.0 maps like +0.0 so the two stay in input order.
+    template<class Ty, class Cmp>
+    class radix_traits {
+    public:
+        using key_type = unsigned_of<sizeof(Ty)>;
+        static constexpr key_type SIGN = key_type(1) << (sizeof(Ty) * 8 - 1);
+
+        static key_type key(Ty value) {
+            key_type bits;
+            if constexpr (std::is_floating_point<Ty>::value) {
+                if (value == 0) {
+                    value = 0;
+                }
+                std::memcpy(&bits, &value, sizeof(Ty));
+                bits = bits & SIGN ? key_type(~bits) : key_type(bits ^ SIGN);
+            } else if constexpr (std::is_signed<Ty>::value) {
+                bits = key_type(value) ^ SIGN;
+            } else {
+                bits = key_type(value);
+            }
+            if constexpr (is_greater<Ty, Cmp>::value) {
+                bits = key_type(~bits);
+            }
+            return bits;
+        }
+
+        static size_t digit(Ty value, int shift) {
+            return (key(value) >> shift) & 0xff;
+        }
+    };
+
+    using radix_count = std::array<size_t, 256>;
+
+    // Stable scatter of src[0, len) by one digit. Each bucket first fills a
+    // cache-line sized staging block and is written out a block at a time.
+    template<class Ty, class Cmp>
+    void radix_scatter(Ty const *src, ptrdiff_t len, Ty *dst, radix_count offset, int shift) {
+        using traits = radix_traits<Ty, Cmp>;
+        constexpr size_t BLOCK = RADIX_COMBINE_BYTES / sizeof(Ty);
+        Ty stage[256][BLOCK];
+        uint8_t fill[256] = {};
+        for (ptrdiff_t n = 0; n < len; ++n) {
+            size_t b = traits::digit(src[n], shift);
+            stage[b][fill[b]++] = src[n];
+            if (fill[b] == BLOCK) {
+                std::memcpy(dst + offset[b], stage[b], sizeof(stage[b]));
+                offset[b] += BLOCK;
+                fill[b] = 0;
+            }
+        }
+        for (size_t b = 0; b < 256; ++b) {
+            std::memcpy(dst + offset[b], stage[b], sizeof(Ty) * fill[b]);
+        }
+    }
+
+    // Parallel LSD radix sort. `buf` must hold last - first elements. The
+    // range is cut into one chunk per thread; every pass histograms the
+    // chunks on the pool, turns the counts into per-chunk offsets in
+    // chunk order (which keeps the sort stable) and scatters the chunks
+    // concurrently. Digits on which every key agrees are skipped.
+    template<class Iter, class Cmp>
+    void radix_sort(Iter first, Iter last, Cmp, typename std::iterator_traits<Iter>::value_type *buf,
+                    thread_pool &pool) {
+        using value_type = typename std::iterator_traits<Iter>::value_type;
+        using traits = radix_traits<value_type, Cmp>;
+        static_assert(is_contiguous_iterator_v<Iter>, "radix_sort needs contiguous storage");
+        int const DIGITS = sizeof(value_type);
+        ptrdiff_t len = last - first;
+        if (len < 2) {
+            return;
+        }
+        ptrdiff_t parts = len < RADIX_PARALLEL_THRESHOLDS ? 1 : (ptrdiff_t) pool.size() + 1;
+        auto bound = [=](ptrdiff_t n) { return len * n / parts; };
+        value_type *src = std::addressof(*first);
+        value_type *dst = buf;
+
+        // One read of the input counts every digit at once.
+        std::vector<radix_count> count(parts * DIGITS);
+        auto histogram = [&](ptrdiff_t t, int d0, int d1) {
+            for (int d = d0; d < d1; ++d) {
+                count[t * DIGITS + d].fill(0);
+            }
+            for (ptrdiff_t n = bound(t); n < bound(t + 1); ++n) {
+                auto key = traits::key(src[n]);
+                for (int d = d0; d < d1; ++d) {
+                    ++count[t * DIGITS + d][(key >> (d * 8)) & 0xff];
+                }
+            }
+        };
+        parallel_for(pool, parts, [&](ptrdiff_t t) { histogram(t, 0, DIGITS); });
+
+        bool fresh = true;
+        std::vector<radix_count> offset(parts);
+        for (int d = 0; d < DIGITS; ++d) {
+            radix_count total{};
+            for (ptrdiff_t t = 0; t < parts; ++t) {
+                for (size_t b = 0; b < 256; ++b) {
+                    total[b] += count[t * DIGITS + d][b];
+                }
+            }
+            if (std::find(total.begin(), total.end(), (size_t) len) != total.end()) {
+                continue;
+            }
+            if (!fresh) {
+                parallel_for(pool, parts, [&](ptrdiff_t t) { histogram(t, d, d + 1); });
+            }
+            size_t sum = 0;
+            for (size_t b = 0; b < 256; ++b) {
+                for (ptrdiff_t t = 0; t < parts; ++t) {
+                    offset[t][b] = sum;
+                    sum += count[t * DIGITS + d][b];
+                }
+            }
+            parallel_for(pool, parts, [&](ptrdiff_t t) {
+                radix_scatter<value_type, Cmp>(src + bound(t), bound(t + 1) - bound(t), dst, offset[t], d * 8);
+            });
+            std::swap(src, dst);
+            fresh = false;
+        }
+        if (src == buf) {
+            value_type *out = std::addressof(*first);
+            parallel_for(pool, parts, [&](ptrdiff_t t) {
+                std::memcpy(out + bound(t), src + bound(t), sizeof(value_type) * (bound(t + 1) - bound(t)));
+            });
+        }
+    }
+
+} // namespace my
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+#include "type_traits.hpp"
+
+namespace my {
+
+    // Lane masks for comparing whole registers of keys: bit sizeof(Ty) * i
+    // and up are set where a[i] < b[i]. Unsigned keys are biased into
+    // signed order; floats compare ordered, as std::less does.
+    template<class Ty>
+    struct scan_lanes {
+        static constexpr bool enabled = false;
+    };
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+    template<class Ty>
+    constexpr bool scan_key_v = (std::is_integral<Ty>::value && !std::is_same<Ty, bool>::value
+                                 && (sizeof(Ty) == 4 || sizeof(Ty) == 8))
+                                || std::is_same<Ty, float>::value || std::is_same<Ty, double>::value;
+
+#if defined(__AVX2__)
+    template<class Ty>
+    struct scan_lanes_avx2 {
+        static constexpr bool enabled = true;
+        static constexpr ptrdiff_t WIDTH = 32 / sizeof(Ty);
+
+        static __m256i load(Ty const *p) {
+            __m256i v = _mm256_loadu_si256((__m256i const *) p);
+            if constexpr (std::is_unsigned<Ty>::value) {
+                v = _mm256_xor_si256(v, sizeof(Ty) == 4 ? _mm256_set1_epi32(INT32_MIN)
+                                                        : _mm256_set1_epi64x(INT64_MIN));
+            }
+            return v;
+        }
+
+        static uint32_t less(Ty const *a, Ty const *b) {
+            if constexpr (std::is_same<Ty, float>::value) {
+                __m256 m = _mm256_cmp_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b), _CMP_LT_OQ);
+                return (uint32_t) _mm256_movemask_epi8(_mm256_castps_si256(m));
+            } else if constexpr (std::is_same<Ty, double>::value) {
+                __m256d m = _mm256_cmp_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b), _CMP_LT_OQ);
+                return (uint32_t) _mm256_movemask_epi8(_mm256_castpd_si256(m));
+            } else if constexpr (sizeof(Ty) == 4) {
+                return (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi32(load(b), load(a)));
+            } else {
+                return (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi64(load(b), load(a)));
+            }
+        }
+    };
+
+    template<class Ty>
+    struct scan_lanes_simd : std::conditional_t<scan_key_v<Ty>, scan_lanes_avx2<Ty>, scan_lanes<Ty>> {
+    };
+#else
+    template<class Ty>
+    struct scan_lanes_sse {
+        static constexpr bool enabled = true;
+        static constexpr ptrdiff_t WIDTH = 16 / sizeof(Ty);
+
+        static __m128i load(Ty const *p) {
+            __m128i v = _mm_loadu_si128((__m128i const *) p);
+            if constexpr (std::is_unsigned<Ty>::value) {
+                v = _mm_xor_si128(v, sizeof(Ty) == 4 ? _mm_set1_epi32(INT32_MIN) : _mm_set1_epi64x(INT64_MIN));
+            }
+            return v;
+        }
+
+        static uint32_t less(Ty const *a, Ty const *b) {
+            if constexpr (std::is_same<Ty, float>::value) {
+                return (uint32_t) _mm_movemask_epi8(_mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(a), _mm_loadu_ps(b))));
+            } else if constexpr (std::is_same<Ty, double>::value) {
+                return (uint32_t) _mm_movemask_epi8(_mm_castpd_si128(_mm_cmplt_pd(_mm_loadu_pd(a), _mm_loadu_pd(b))));
+            } else if constexpr (sizeof(Ty) == 4) {
+                return (uint32_t) _mm_movemask_epi8(_mm_cmpgt_epi32(load(b), load(a)));
+            } else {
+                return (uint32_t) _mm_movemask_epi8(_mm_cmpgt_epi64(load(b), load(a)));
+            }
+        }
+    };
+
+    template<class Ty>
+    struct scan_lanes_simd : std::conditional_t<scan_key_v<Ty>, scan_lanes_sse<Ty>, scan_lanes<Ty>> {
+    };
+#endif
+#else
+    template<class Ty>
+    struct scan_lanes_simd : scan_lanes<Ty> {
+    };
+#endif
+
+    template<class Iter, class Cmp>
+    constexpr bool use_run_scan_v = is_contiguous_iterator_v<Iter>
+                                    && is_standard_order_v<typename std::iterator_traits<Iter>::value_type, Cmp>
+                                    && scan_lanes_simd<typename std::iterator_traits<Iter>::value_type>::enabled;
+
+    // First position q in (first, last) with stop(q[-1], q[0]), or last.
+    // Keys under std::less / std::greater in contiguous storage are tested
+    // a register at a time; `ahead` says stop(a, b) is cmp(b, a) rather
+    // than cmp(a, b), which fixes the operand order of the lane compare.
+    template<bool Ahead, class Iter, class Cmp>
+    Iter scan_until(Iter first, Iter last, Cmp cmp) {
+        auto stop = [&](auto const &prev, auto const &cur) { return Ahead ? cmp(cur, prev) : cmp(prev, cur); };
+        if (first == last) {
+            return last;
+        }
+        Iter it = first + 1;
+        if constexpr (use_run_scan_v<Iter, Cmp>) {
+            using value_type = typename std::iterator_traits<Iter>::value_type;
+            using lanes = scan_lanes_simd<value_type>;
+            value_type const *p = std::addressof(*first);
+            ptrdiff_t len = last - first;
+            ptrdiff_t n = 1;
+            // cmp(x, y) is x < y under less and y < x under greater.
+            constexpr bool swap = Ahead != is_greater<value_type, Cmp>::value;
+            for (; n + lanes::WIDTH <= len; n += lanes::WIDTH) {
+                uint32_t mask = swap ? lanes::less(p + n, p + n - 1) : lanes::less(p + n - 1, p + n);
+                if (mask != 0) {
+                    return first + n + __builtin_ctz(mask) / sizeof(value_type);
+                }
+            }
+            it = first + n;
+        }
+        for (; it != last; ++it) {
+            if (stop(it[-1], it[0])) {
+                return it;
+            }
+        }
+        return last;
+    }
+
+    // End of the run ascending under cmp that starts at `first`.
+    template<class Iter, class Cmp>
+    Iter ascending_end(Iter first, Iter last, Cmp cmp) {
+        return scan_until<true>(first, last, cmp);
+    }
+
+    // End of the run descending under cmp (equal neighbours allowed) that
+    // starts at `first`.
+    template<class Iter, class Cmp>
+    Iter descending_end(Iter first, Iter last, Cmp cmp) {
+        return scan_until<false>(first, last, cmp);
+    }
+
+} // namespace my
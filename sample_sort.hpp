@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace my {
+
+    ptrdiff_t const SAMPLE_SORT_THRESHOLDS = 1 << 16;
+    // Buckets up to this long go to the base sort.
+    ptrdiff_t const SAMPLE_SORT_BASE = 1 << 12;
+    // At most 2 * 128 - 1 buckets with equality buckets, so a bucket
+    // number fits a byte.
+    size_t const SAMPLE_SORT_MAX_BUCKETS = 128;
+    // Levels of distribution before the base sort takes whatever is left.
+    int const SAMPLE_SORT_MAX_DEPTH = 8;
+
+    // Maps an element to its bucket through a branchless search tree over
+    // k - 1 sorted splitters (k a power of two, Eytzinger order, tree[1] the
+    // root): log2(k) steps of i = 2i + !(e < tree[i]) leave i - k, the
+    // number of splitters not greater than e. With equality buckets every
+    // splitter also gets a bucket of its own for the elements equal to it,
+    // between the buckets on either side, which never need sorting.
+    template<class Iter, class Cmp>
+    class sample_classifier {
+        using reference = typename std::iterator_traits<Iter>::reference;
+        std::vector<Iter> tree;
+        std::vector<Iter> splitters;
+        size_t k;
+        int log_k = 0;
+        bool equal;
+        Cmp cmp;
+
+        size_t fill(size_t i, size_t pos) {
+            if (i < k) {
+                pos = fill(2 * i, pos);
+                tree[i] = splitters[pos++];
+                pos = fill(2 * i + 1, pos);
+            }
+            return pos;
+        }
+
+    public:
+        // `splitters` sorted, at most k - 1 of them; equal ones call for
+        // equality buckets, as does `equal`.
+        sample_classifier(std::vector<Iter> sorted, Cmp cmp, bool equal = false)
+                : splitters(std::move(sorted)), equal(equal), cmp(cmp) {
+            auto same = [&](Iter a, Iter b) { return !cmp(*a, *b); };
+            this->equal |= std::adjacent_find(splitters.begin(), splitters.end(), same) != splitters.end();
+            if (this->equal) {
+                splitters.erase(std::unique(splitters.begin(), splitters.end(), same), splitters.end());
+            }
+            k = 2;
+            while (k - 1 < splitters.size()) {
+                k *= 2;
+            }
+            splitters.resize(k - 1, splitters.back());
+            while ((size_t(1) << log_k) < k) {
+                ++log_k;
+            }
+            tree.resize(k);
+            fill(1, 0);
+        }
+
+        size_t buckets() const {
+            return equal ? 2 * k - 1 : k;
+        }
+
+        // Whether bucket b holds only elements equal to one splitter.
+        bool is_equal_bucket(size_t b) const {
+            return equal && b % 2 == 1;
+        }
+
+        size_t operator()(reference e) const {
+            size_t i = 1;
+            for (int l = 0; l < log_k; ++l) {
+                i = 2 * i + !cmp(e, *tree[i]);
+            }
+            size_t b = i - k;
+            if (equal) {
+                return 2 * b - (b > 0 && !cmp(*splitters[b - 1], e));
+            }
+            return b;
+        }
+    };
+
+    // Stable sample sort, after IPS4o but with an out-of-place, stable
+    // distribution. Splitters are picked from an oversampled, sorted
+    // random sample; every chunk classifies its elements through the
+    // branchless tree and counts its buckets; counts are turned into
+    // bucket-major, chunk-minor offsets, which keeps equal elements in
+    // input order, and each chunk moves its elements into `buf` (room for
+    // last - first elements, raw). Each bucket then moves back and is
+    // sorted on its own, on the pool at the top level, in its slice of buf.
+    // Small buckets, and everything below SAMPLE_SORT_MAX_DEPTH, go to
+    // base(first, last, buf), which must sort stably.
+    template<class Iter, class Cmp, class Base>
+    void sample_sort(Iter first, Iter last, Cmp cmp, typename std::iterator_traits<Iter>::value_type *buf,
+                     thread_pool &pool, Base const &base, int depth = 0) {
+        using value_type = typename std::iterator_traits<Iter>::value_type;
+        ptrdiff_t len = last - first;
+        if (len <= SAMPLE_SORT_BASE || depth >= SAMPLE_SORT_MAX_DEPTH) {
+            base(first, last, buf);
+            return;
+        }
+
+        size_t k = 2;
+        while (k < SAMPLE_SORT_MAX_BUCKETS && ptrdiff_t(k) * SAMPLE_SORT_BASE / 4 < len) {
+            k *= 2;
+        }
+        size_t log_n = 0;
+        while ((ptrdiff_t(1) << log_n) < len) {
+            ++log_n;
+        }
+        size_t alpha = std::max<size_t>(1, log_n / 5);
+        std::minstd_rand rand(uint32_t(len) + depth);
+        std::vector<Iter> sample(alpha * k - 1);
+        for (Iter &it : sample) {
+            it = first + std::uniform_int_distribution<ptrdiff_t>(0, len - 1)(rand);
+        }
+        std::sort(sample.begin(), sample.end(), [&](Iter a, Iter b) { return cmp(*a, *b); });
+        // Few keys in the sample: every one of them gets its equality
+        // bucket, so one pass places most elements for good.
+        std::vector<Iter> keys(sample);
+        keys.erase(std::unique(keys.begin(), keys.end(), [&](Iter a, Iter b) { return !cmp(*a, *b); }),
+                   keys.end());
+        bool few = keys.size() < k;
+        std::vector<Iter> splitters(few ? keys.size() : k - 1);
+        for (size_t n = 0; n < splitters.size(); ++n) {
+            splitters[n] = few ? keys[n] : sample[(n + 1) * alpha - 1];
+        }
+        sample_classifier<Iter, Cmp> classify(std::move(splitters), cmp, few);
+        size_t buckets = classify.buckets();
+
+        ptrdiff_t parts = depth > 0 || len < SAMPLE_SORT_THRESHOLDS ? 1 : (ptrdiff_t) pool.size() + 1;
+        auto bound = [=](ptrdiff_t t) { return len * t / parts; };
+        std::vector<uint8_t> oracle(len);
+        std::vector<size_t> count(parts * buckets);
+        auto scan = [&](ptrdiff_t t) {
+            // A copy per chunk, comparator and all: Cmp may keep state of
+            // its own (counted_cmp does), so no two threads share one.
+            sample_classifier<Iter, Cmp> const mine(classify);
+            size_t *cnt = count.data() + t * buckets;
+            for (ptrdiff_t n = bound(t); n < bound(t + 1); ++n) {
+                size_t b = mine(first[n]);
+                oracle[n] = uint8_t(b);
+                ++cnt[b];
+            }
+        };
+        parallel_for(pool, parts, scan);
+
+        std::vector<ptrdiff_t> start(buckets + 1);
+        std::vector<size_t> offset(parts * buckets);
+        size_t sum = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            start[b] = sum;
+            for (ptrdiff_t t = 0; t < parts; ++t) {
+                offset[t * buckets + b] = sum;
+                sum += count[t * buckets + b];
+            }
+        }
+        start[buckets] = sum;
+        auto distribute = [&](ptrdiff_t t) {
+            size_t *off = offset.data() + t * buckets;
+            for (ptrdiff_t n = bound(t); n < bound(t + 1); ++n) {
+                new(buf + off[oracle[n]]++) value_type(std::move(first[n]));
+            }
+        };
+        parallel_for(pool, parts, distribute);
+        oracle = std::vector<uint8_t>();
+
+        auto finish = [=, &pool, &base, &classify](size_t b) {
+            Iter lo = first + start[b];
+            Iter hi = first + start[b + 1];
+            value_type *src = buf + start[b];
+            std::move(src, src + (hi - lo), lo);
+            std::destroy(src, src + (hi - lo));
+            if (hi - lo > 1 && !classify.is_equal_bucket(b)) {
+                sample_sort(lo, hi, cmp, src, pool, base, depth + 1);
+            }
+        };
+        if (parts > 1) {
+            // A group of its own: a bucket's sort may run inside wait().
+            task_group group(pool);
+            for (size_t b = 1; b < buckets; ++b) {
+                group.run([&, b] { finish(b); });
+            }
+            finish(0);
+            group.wait();
+        } else {
+            for (size_t b = 0; b < buckets; ++b) {
+                finish(b);
+            }
+        }
+    }
+
+} // namespace my
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace my {
+
+    // Raw scratch memory that grows once and is then reused by every merge.
+    // The storage is either owned (malloc, or mmap with transparent huge
+    // pages on Linux) or supplied by the caller, in which case it is never
+    // freed here. Objects placed in it are managed by the user.
+    class scratch {
+        void *ptr{nullptr};
+        size_t len{0};
+        bool owned{false};
+        bool mapped{false};
+        bool huge{false};
+
+    public:
+        scratch() = default;
+
+        scratch(scratch const &) = delete;
+
+        scratch &operator=(scratch const &) = delete;
+
+        ~scratch() {
+            release();
+        }
+
+        size_t capacity() const {
+            return len;
+        }
+
+        template<class Ty>
+        Ty *data() const {
+            return static_cast<Ty *>(ptr);
+        }
+
+        // Back later allocations with huge pages where the platform allows it.
+        void use_huge_pages(bool on) {
+            huge = on;
+        }
+
+        bool huge_pages() const {
+            return huge;
+        }
+
+        // Use a caller-owned buffer. It must be aligned for the element type
+        // and stay alive while sorts use it.
+        void assign(void *buf, size_t bytes) {
+            release();
+            ptr = buf;
+            len = bytes;
+        }
+
+        void reserve(size_t bytes) {
+            if (bytes <= len) {
+                return;
+            }
+            release();
+#ifdef __linux__
+            size_t const HUGE_PAGE = 2 << 20;
+            if (huge && bytes >= HUGE_PAGE) {
+                size_t size = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+                void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (map != MAP_FAILED) {
+                    madvise(map, size, MADV_HUGEPAGE);
+                    ptr = map;
+                    len = size;
+                    owned = true;
+                    mapped = true;
+                    return;
+                }
+            }
+#endif
+            ptr = malloc(bytes);
+            if (ptr == nullptr) {
+                throw std::bad_alloc();
+            }
+            len = bytes;
+            owned = true;
+        }
+
+        void release() {
+            if (owned) {
+#ifdef __linux__
+                if (mapped) {
+                    munmap(ptr, len);
+                } else {
+                    free(ptr);
+                }
+#else
+                free(ptr);
+#endif
+            }
+            ptr = nullptr;
+            len = 0;
+            owned = false;
+            mapped = false;
+        }
+    };
+
+} // namespace my
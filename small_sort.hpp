@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#include "type_traits.hpp"
+
+namespace my {
+
+    ptrdiff_t const INSERT_THRESHOLDS = 64;
+
+    template<class Iter,
+            class Cmp = std::less<typename std::iterator_traits<Iter>::value_type>>
+    void insert_sort(Iter first, Iter last, Cmp cmp = Cmp{}) {
+        for (Iter for_x = first + 1; for_x < last; ++for_x) {
+            Iter for_y = for_x;
+            auto tmp = for_y[0];
+            for (; first < for_y && cmp(tmp, for_y[-1]); --for_y) {
+                for_y[0] = for_y[-1];
+            }
+            for_y[0] = tmp;
+        }
+    }
+
+    // Insertion sort that finds each slot with a binary search, for
+    // comparators that cost more than the moves they save.
+    template<class Iter, class Cmp>
+    void binary_insert_sort(Iter first, Iter last, Cmp cmp) {
+        for (Iter it = first + 1; it < last; ++it) {
+            if (!cmp(it[0], it[-1])) {
+                continue;
+            }
+            auto tmp = std::move(it[0]);
+            Iter pos = std::upper_bound(first, it, tmp, cmp);
+            std::move_backward(pos, it, it + 1);
+            *pos = std::move(tmp);
+        }
+    }
+
+    // Sorting networks are not stable. They are only used where equal keys
+    // cannot be told apart: integers under std::less / std::greater.
+    template<class Ty, class Cmp>
+    constexpr bool use_network_v = std::is_integral<Ty>::value
+                                   && !std::is_same<Ty, bool>::value
+                                   && is_standard_order_v<Ty, Cmp>;
+
+    template<class Ty>
+    inline void network_swap(Ty &a, Ty &b) {
+        Ty x = a;
+        Ty y = b;
+        a = x < y ? x : y;
+        b = x < y ? y : x;
+    }
+
+    // Optimal 19-comparator network for 8 keys.
+    template<class Ty>
+    void network_sort8(Ty *v) {
+        network_swap(v[0], v[2]);
+        network_swap(v[1], v[3]);
+        network_swap(v[4], v[6]);
+        network_swap(v[5], v[7]);
+        network_swap(v[0], v[4]);
+        network_swap(v[1], v[5]);
+        network_swap(v[2], v[6]);
+        network_swap(v[3], v[7]);
+        network_swap(v[0], v[1]);
+        network_swap(v[2], v[3]);
+        network_swap(v[4], v[5]);
+        network_swap(v[6], v[7]);
+        network_swap(v[2], v[4]);
+        network_swap(v[3], v[5]);
+        network_swap(v[1], v[4]);
+        network_swap(v[3], v[6]);
+        network_swap(v[1], v[2]);
+        network_swap(v[3], v[4]);
+        network_swap(v[5], v[6]);
+    }
+
+    // Same network applied lane-wise to eight vector rows; `Min` and `Max`
+    // are the element-wise min / max for the register type.
+    template<class Reg, class Min, class Max>
+    inline void network_rows8(Reg *r, Min min, Max max) {
+        auto cx = [&](int i, int j) {
+            Reg lo = min(r[i], r[j]);
+            Reg hi = max(r[i], r[j]);
+            r[i] = lo;
+            r[j] = hi;
+        };
+        cx(0, 2), cx(1, 3), cx(4, 6), cx(5, 7);
+        cx(0, 4), cx(1, 5), cx(2, 6), cx(3, 7);
+        cx(0, 1), cx(2, 3), cx(4, 5), cx(6, 7);
+        cx(2, 4), cx(3, 5);
+        cx(1, 4), cx(3, 6);
+        cx(1, 2), cx(3, 4), cx(5, 6);
+    }
+
+    template<class Reg, class Min, class Max>
+    inline void network_rows4(Reg *r, Min min, Max max) {
+        auto cx = [&](int i, int j) {
+            Reg lo = min(r[i], r[j]);
+            Reg hi = max(r[i], r[j]);
+            r[i] = lo;
+            r[j] = hi;
+        };
+        cx(0, 1), cx(2, 3);
+        cx(0, 2), cx(1, 3);
+        cx(1, 2);
+    }
+
+    // Cuts v[0, len) into sorted runs with a compare-exchange network and
+    // returns the run length. len must be a multiple of network_group().
+    template<class Ty>
+    ptrdiff_t network_runs(Ty *v, ptrdiff_t len) {
+#if defined(__AVX2__)
+        if constexpr (sizeof(Ty) == 4) {
+            // 8x8 block: sort the columns across registers, then transpose so
+            // every column becomes a contiguous run of 8.
+            for (ptrdiff_t n = 0; n < len; n += 64) {
+                __m256i r[8];
+                for (int i = 0; i < 8; ++i) {
+                    r[i] = _mm256_loadu_si256((__m256i const *) (v + n + 8 * i));
+                }
+                if constexpr (std::is_signed<Ty>::value) {
+                    network_rows8(r, [](__m256i a, __m256i b) { return _mm256_min_epi32(a, b); },
+                                  [](__m256i a, __m256i b) { return _mm256_max_epi32(a, b); });
+                } else {
+                    network_rows8(r, [](__m256i a, __m256i b) { return _mm256_min_epu32(a, b); },
+                                  [](__m256i a, __m256i b) { return _mm256_max_epu32(a, b); });
+                }
+                __m256i t[8], u[8];
+                for (int i = 0; i < 8; i += 2) {
+                    t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+                    t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+                }
+                for (int i = 0; i < 8; i += 4) {
+                    u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+                    u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+                    u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+                    u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+                }
+                for (int i = 0; i < 4; ++i) {
+                    r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+                    r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+                }
+                for (int i = 0; i < 8; ++i) {
+                    _mm256_storeu_si256((__m256i *) (v + n + 8 * i), r[i]);
+                }
+            }
+            return 8;
+        } else if constexpr (sizeof(Ty) == 8) {
+            // 4x4 block of 64-bit keys; AVX2 has no 64-bit min / max, so
+            // compare and blend, flipping the sign bit for unsigned keys.
+            __m256i const bias = std::is_signed<Ty>::value
+                                 ? _mm256_setzero_si256()
+                                 : _mm256_set1_epi64x(INT64_MIN);
+            auto gt = [=](__m256i a, __m256i b) {
+                return _mm256_cmpgt_epi64(_mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias));
+            };
+            for (ptrdiff_t n = 0; n < len; n += 16) {
+                __m256i r[4];
+                for (int i = 0; i < 4; ++i) {
+                    r[i] = _mm256_loadu_si256((__m256i const *) (v + n + 4 * i));
+                }
+                network_rows4(r, [=](__m256i a, __m256i b) { return _mm256_blendv_epi8(a, b, gt(a, b)); },
+                              [=](__m256i a, __m256i b) { return _mm256_blendv_epi8(b, a, gt(a, b)); });
+                __m256i t0 = _mm256_unpacklo_epi64(r[0], r[1]);
+                __m256i t1 = _mm256_unpackhi_epi64(r[0], r[1]);
+                __m256i t2 = _mm256_unpacklo_epi64(r[2], r[3]);
+                __m256i t3 = _mm256_unpackhi_epi64(r[2], r[3]);
+                r[0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+                r[1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+                r[2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+                r[3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+                for (int i = 0; i < 4; ++i) {
+                    _mm256_storeu_si256((__m256i *) (v + n + 4 * i), r[i]);
+                }
+            }
+            return 4;
+        }
+#elif defined(__SSE4_1__)
+        if constexpr (sizeof(Ty) == 4) {
+            // 4x4 block, transposed through the float shuffle macro.
+            for (ptrdiff_t n = 0; n < len; n += 16) {
+                __m128i r[4];
+                for (int i = 0; i < 4; ++i) {
+                    r[i] = _mm_loadu_si128((__m128i const *) (v + n + 4 * i));
+                }
+                if constexpr (std::is_signed<Ty>::value) {
+                    network_rows4(r, [](__m128i a, __m128i b) { return _mm_min_epi32(a, b); },
+                                  [](__m128i a, __m128i b) { return _mm_max_epi32(a, b); });
+                } else {
+                    network_rows4(r, [](__m128i a, __m128i b) { return _mm_min_epu32(a, b); },
+                                  [](__m128i a, __m128i b) { return _mm_max_epu32(a, b); });
+                }
+                __m128 f0 = _mm_castsi128_ps(r[0]);
+                __m128 f1 = _mm_castsi128_ps(r[1]);
+                __m128 f2 = _mm_castsi128_ps(r[2]);
+                __m128 f3 = _mm_castsi128_ps(r[3]);
+                _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+                _mm_storeu_si128((__m128i *) (v + n), _mm_castps_si128(f0));
+                _mm_storeu_si128((__m128i *) (v + n + 4), _mm_castps_si128(f1));
+                _mm_storeu_si128((__m128i *) (v + n + 8), _mm_castps_si128(f2));
+                _mm_storeu_si128((__m128i *) (v + n + 12), _mm_castps_si128(f3));
+            }
+            return 4;
+        }
+#endif
+        for (ptrdiff_t n = 0; n < len; n += 8) {
+            network_sort8(v + n);
+        }
+        return 8;
+    }
+
+    // Number of keys network_runs() handles per step for `Ty`.
+    template<class Ty>
+    constexpr ptrdiff_t network_group() {
+#if defined(__AVX2__)
+        return sizeof(Ty) == 4 ? 64 : sizeof(Ty) == 8 ? 16 : 8;
+#elif defined(__SSE4_1__)
+        return sizeof(Ty) == 4 ? 16 : 8;
+#else
+        return 8;
+#endif
+    }
+
+    // Merge without data-dependent branches; ties take from `a`.
+    template<class Ty>
+    void branchless_merge(Ty const *a, ptrdiff_t na, Ty const *b, ptrdiff_t nb, Ty *out) {
+        ptrdiff_t i = 0;
+        ptrdiff_t j = 0;
+        while (i < na && j < nb) {
+            bool take_b = b[j] < a[i];
+            *out++ = take_b ? b[j] : a[i];
+            j += take_b;
+            i += !take_b;
+        }
+        std::memcpy(out, a + i, sizeof(Ty) * (na - i));
+        std::memcpy(out + (na - i), b + j, sizeof(Ty) * (nb - j));
+    }
+
+    // Base case for integer keys: pad with the largest key, sort fixed
+    // blocks with a (SIMD) network, then merge the blocks branch-free.
+    template<class Iter, class Cmp>
+    void network_sort(Iter first, Iter last, Cmp) {
+        using value_type = typename std::iterator_traits<Iter>::value_type;
+        ptrdiff_t const GROUP = network_group<value_type>();
+        ptrdiff_t const SIZE = (INSERT_THRESHOLDS + GROUP - 1) / GROUP * GROUP;
+        alignas(32) value_type ping[SIZE];
+        alignas(32) value_type pong[SIZE];
+        ptrdiff_t len = last - first;
+        ptrdiff_t full = len <= 8 ? 8 : (len + GROUP - 1) / GROUP * GROUP;
+        std::copy(first, last, ping);
+        std::fill(ping + len, ping + full, std::numeric_limits<value_type>::max());
+        value_type *src = ping;
+        value_type *dst = pong;
+        ptrdiff_t width = 8;
+        if (full == 8) {
+            network_sort8(src);
+        } else {
+            width = network_runs(src, full);
+        }
+        for (; width < full; width <<= 1) {
+            for (ptrdiff_t n = 0; n < full; n += width << 1) {
+                ptrdiff_t mid = std::min(n + width, full);
+                ptrdiff_t end = std::min(n + (width << 1), full);
+                branchless_merge(src + n, mid - n, src + mid, end - mid, dst + n);
+            }
+            std::swap(src, dst);
+        }
+        if (is_greater<value_type, Cmp>::value) {
+            std::reverse_copy(src, src + len, first);
+        } else {
+            std::copy(src, src + len, first);
+        }
+    }
+
+    // Leaf of every merge sort: picks the kernel from the key type and the
+    // comparator at compile time.
+    template<class Iter, class Cmp>
+    void small_sort(Iter first, Iter last, Cmp cmp) {
+        using value_type = typename std::iterator_traits<Iter>::value_type;
+        if (last - first < 2) {
+            return;
+        }
+        if constexpr (use_network_v<value_type, Cmp>) {
+            if (last - first <= INSERT_THRESHOLDS) {
+                network_sort(first, last, cmp);
+            } else {
+                insert_sort(first, last, cmp);
+            }
+        } else if constexpr (std::is_arithmetic<value_type>::value && is_standard_order_v<value_type, Cmp>) {
+            insert_sort(first, last, cmp);
+        } else {
+            binary_insert_sort(first, last, cmp);
+        }
+    }
+
+} // namespace my
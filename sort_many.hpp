@@ -0,0 +1,79 @@
+#pragma once
+
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "timsort.hpp"
+
+namespace my {
+
+    // Ranges at least this long are sorted one at a time with the whole
+    // pool on each; shorter ones are sorted whole inside one task, and
+    // tasks are filled up to SORT_MANY_BATCH elements.
+    ptrdiff_t const SORT_MANY_SPLIT_THRESHOLDS = 1 << 16;
+    ptrdiff_t const SORT_MANY_BATCH = 1 << 14;
+
+    template<class Ranges>
+    using range_iterator_t = decltype(std::begin(*std::begin(std::declval<Ranges &>())));
+
+    // A pool without workers: what is posted to it runs in wait() on the
+    // posting thread. One per thread, so a sort inside a task runs serially
+    // and never queues work behind the task that started it.
+    inline thread_pool &inline_pool() {
+        static thread_local thread_pool pool(0);
+        return pool;
+    }
+
+    // Sorts every range of `ranges` (std::vector<std::vector<T>> or any
+    // container of ranges with random access iterators) stably under cmp.
+    // The whole batch shares `pool`: short ranges are grouped so one task
+    // sorts many, each with its own reused scratch, while the calling
+    // thread sorts the long ranges, which split across the pool as usual.
+    template<class Ranges,
+            class Cmp = std::less<typename std::iterator_traits<range_iterator_t<Ranges>>::value_type>>
+    void sort_many(Ranges &ranges, Cmp cmp = {}, thread_pool &pool = thread_pool::instance()) {
+        using Iter = range_iterator_t<Ranges>;
+        using slice = std::pair<Iter, Iter>;
+        std::vector<slice> large;
+        std::vector<slice> batch;
+        ptrdiff_t filled = 0;
+        task_group group(pool);
+        auto flush = [&] {
+            group.run([cmp, batch = std::move(batch)] {
+                timsort<Iter, Cmp> tim(inline_pool());
+                for (auto const &range : batch) {
+                    tim.sort(range.first, range.second, cmp);
+                }
+            });
+            batch.clear();
+            filled = 0;
+        };
+        for (auto &range : ranges) {
+            Iter first = std::begin(range);
+            Iter last = std::end(range);
+            ptrdiff_t len = last - first;
+            if (len < 2) {
+                continue;
+            }
+            if (len >= SORT_MANY_SPLIT_THRESHOLDS) {
+                large.emplace_back(first, last);
+                continue;
+            }
+            batch.emplace_back(first, last);
+            filled += len;
+            if (filled >= SORT_MANY_BATCH) {
+                flush();
+            }
+        }
+        if (!batch.empty()) {
+            flush();
+        }
+        timsort<Iter, Cmp> tim(pool);
+        for (auto const &range : large) {
+            tim.sort(range.first, range.second, cmp);
+        }
+        group.wait();
+    }
+
+} // namespace my
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "thread_pool.hpp"
+#include "type_traits.hpp"
+
+namespace my {
+
+    // Parts of a sort timed on their own.
+    enum class sort_phase {
+        estimate,
+        runs,
+        merge,
+        radix,
+        strings,
+        sample,
+        keys,
+    };
+
+    size_t const SORT_PHASES = 7;
+
+    inline char const *phase_name(sort_phase phase) {
+        static char const *const names[SORT_PHASES] = {
+                "estimate", "runs", "merge", "radix", "strings", "sample", "keys",
+        };
+        return names[size_t(phase)];
+    }
+
+    // timsort's default statistics policy. Every hook is empty and inline,
+    // and the sorter compares with Cmp itself, so a sorter built with it is
+    // the sorter without statistics.
+    struct no_stats {
+        static constexpr bool enabled = false;
+
+        void reset() {
+        }
+
+        void count_moves(ptrdiff_t) {
+        }
+
+        void count_run(ptrdiff_t) {
+        }
+
+        void count_pass(ptrdiff_t, size_t) {
+        }
+
+        void count_scratch(size_t) {
+        }
+
+        template<class Waitable>
+        void wait(Waitable &on) {
+            on.wait();
+        }
+
+        void start(sort_phase) {
+        }
+
+        void stop(sort_phase) {
+        }
+
+        void absorb(no_stats const &) {
+        }
+    };
+
+    // A counter bumped from many threads at once: each thread adds to a
+    // slot of its own cache line, and reading sums the slots.
+    class striped_counter {
+        static size_t const SLOTS = 64;
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> value{0};
+        };
+        std::array<Slot, SLOTS> slots;
+
+        static size_t slot() {
+            static std::atomic<size_t> next{0};
+            static thread_local size_t mine = next++ % SLOTS;
+            return mine;
+        }
+
+    public:
+        void add(uint64_t n = 1) {
+            slots[slot()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t load() const {
+            uint64_t sum = 0;
+            for (Slot const &ref : slots) {
+                sum += ref.value.load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+        void reset() {
+            for (Slot &ref : slots) {
+                ref.value.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // The comparator a sorter with statistics hands its engines: Cmp,
+    // counting every call. Each copy counts into a plain tally of its own
+    // and adds it to `calls` when it goes away; the engines copy their
+    // comparator into every task, so that is once per task rather than an
+    // atomic add per comparison. A copy starts from zero, and one copy is
+    // never called from two threads at once.
+    template<class Cmp>
+    struct counted_cmp {
+        Cmp cmp;
+        striped_counter *calls;
+        mutable uint64_t tally = 0;
+
+        counted_cmp(Cmp cmp, striped_counter *calls) : cmp(cmp), calls(calls) {
+        }
+
+        counted_cmp(counted_cmp const &other) noexcept(std::is_nothrow_copy_constructible<Cmp>::value)
+                : cmp(other.cmp), calls(other.calls) {
+        }
+
+        counted_cmp &operator=(counted_cmp const &other) {
+            flush();
+            cmp = other.cmp;
+            calls = other.calls;
+            return *this;
+        }
+
+        ~counted_cmp() {
+            flush();
+        }
+
+        void flush() const {
+            if (tally != 0) {
+                calls->add(tally);
+                tally = 0;
+            }
+        }
+
+        template<class Left, class Right>
+        bool operator()(Left const &left, Right const &right) const {
+            ++tally;
+            return cmp(left, right);
+        }
+    };
+
+    // Counting leaves the order alone: the network, SIMD scan and radix
+    // paths see Cmp. They do not call it, so their comparisons are not
+    // counted.
+    template<class Ty, class Cmp>
+    class is_less<Ty, counted_cmp<Cmp>> : public is_less<Ty, Cmp> {
+    };
+
+    template<class Ty, class Cmp>
+    class is_greater<Ty, counted_cmp<Cmp>> : public is_greater<Ty, Cmp> {
+    };
+
+    // Statistics of the last timsort::sort: comparator calls, the element
+    // moves made by merging (the small sorts and the radix and sample
+    // distributions are not counted), the natural runs found, bytes merged
+    // per pass, scratch held, time spent in the sorter's own waits on the
+    // pool (tasks a wait runs inline count towards it;
+    // the radix, string and sample engines wait on their own), and wall and
+    // CPU time per phase. CPU time is the process's, so it covers the
+    // pool's threads. With use_perf(true) on Linux every phase also counts
+    // the calling thread's cache misses through perf_event_open; the count
+    // stays at -1 where the kernel refuses.
+    class sort_stats {
+    public:
+        static constexpr bool enabled = true;
+
+        struct Pass {
+            ptrdiff_t merges = 0;
+            size_t bytes = 0;
+        };
+
+        struct Phase {
+            ptrdiff_t calls = 0;
+            double wall = 0;
+            double cpu = 0;
+            int64_t cache_misses = -1;
+        };
+
+        striped_counter comparisons;
+        std::atomic<ptrdiff_t> moves{0};
+        ptrdiff_t runs = 0;
+        // runs_by_length[i] counts natural runs of length in [2^i, 2^(i+1)).
+        std::array<ptrdiff_t, 64> runs_by_length{};
+        std::vector<Pass> passes;
+        size_t scratch_bytes = 0;
+        // Seconds spent waiting on the pool.
+        double waited = 0;
+        std::array<Phase, SORT_PHASES> phases{};
+
+    private:
+        using clock = std::chrono::steady_clock;
+        std::array<clock::time_point, SORT_PHASES> wall_begin{};
+        std::array<std::clock_t, SORT_PHASES> cpu_begin{};
+        std::array<int64_t, SORT_PHASES> perf_begin{};
+        int perf_fd = -1;
+
+        int64_t read_perf() const {
+            int64_t count = -1;
+#if __linux__
+            if (perf_fd >= 0 && read(perf_fd, &count, sizeof(count)) != sizeof(count)) {
+                count = -1;
+            }
+#endif
+            return count;
+        }
+
+    public:
+        sort_stats() = default;
+
+        sort_stats(sort_stats const &) = delete;
+
+        sort_stats &operator=(sort_stats const &) = delete;
+
+        ~sort_stats() {
+            use_perf(false);
+        }
+
+        bool uses_perf() const {
+            return perf_fd >= 0;
+        }
+
+        void use_perf(bool on) {
+#if __linux__
+            if (on && perf_fd < 0) {
+                perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                perf_fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            } else if (!on && perf_fd >= 0) {
+                close(perf_fd);
+                perf_fd = -1;
+            }
+#else
+            (void) on;
+#endif
+        }
+
+        void reset() {
+            comparisons.reset();
+            moves = 0;
+            runs = 0;
+            runs_by_length.fill(0);
+            passes.clear();
+            scratch_bytes = 0;
+            waited = 0;
+            phases.fill(Phase());
+        }
+
+        void count_moves(ptrdiff_t n) {
+            moves.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        void count_run(ptrdiff_t len) {
+            ++runs;
+            ++runs_by_length[63 - __builtin_clzll(uint64_t(len))];
+        }
+
+        void count_pass(ptrdiff_t merges, size_t bytes) {
+            passes.push_back(Pass{merges, bytes});
+        }
+
+        void count_scratch(size_t bytes) {
+            scratch_bytes += bytes;
+        }
+
+        // Waits on a thread_pool or a task_group, timing it.
+        template<class Waitable>
+        void wait(Waitable &on) {
+            auto begin = clock::now();
+            on.wait();
+            waited += std::chrono::duration<double>(clock::now() - begin).count();
+        }
+
+        void start(sort_phase phase) {
+            size_t p = size_t(phase);
+            perf_begin[p] = read_perf();
+            cpu_begin[p] = std::clock();
+            wall_begin[p] = clock::now();
+        }
+
+        void stop(sort_phase phase) {
+            size_t p = size_t(phase);
+            Phase &ref = phases[p];
+            ++ref.calls;
+            ref.wall += std::chrono::duration<double>(clock::now() - wall_begin[p]).count();
+            ref.cpu += double(std::clock() - cpu_begin[p]) / CLOCKS_PER_SEC;
+            int64_t misses = read_perf();
+            if (misses >= 0 && perf_begin[p] >= 0) {
+                ref.cache_misses = std::max<int64_t>(ref.cache_misses, 0) + misses - perf_begin[p];
+            }
+        }
+
+        // Adds what a nested sorter recorded (the key cache and projected
+        // sorts run one).
+        void absorb(sort_stats const &other) {
+            comparisons.add(other.comparisons.load());
+            moves += other.moves;
+            runs += other.runs;
+            for (size_t i = 0; i < runs_by_length.size(); ++i) {
+                runs_by_length[i] += other.runs_by_length[i];
+            }
+            passes.insert(passes.end(), other.passes.begin(), other.passes.end());
+            scratch_bytes += other.scratch_bytes;
+            waited += other.waited;
+            for (size_t p = 0; p < SORT_PHASES; ++p) {
+                Phase &ref = phases[p];
+                Phase const &add = other.phases[p];
+                ref.calls += add.calls;
+                ref.wall += add.wall;
+                ref.cpu += add.cpu;
+                if (add.cache_misses >= 0) {
+                    ref.cache_misses = std::max<int64_t>(ref.cache_misses, 0) + add.cache_misses;
+                }
+            }
+        }
+
+        // Times in seconds; phases that never ran are left out, and so are
+        // the empty tail of the run histogram and cache misses not counted.
+        std::string json() const {
+            std::ostringstream out;
+            out << "{\"comparisons\":" << comparisons.load()
+                << ",\"moves\":" << moves.load()
+                << ",\"runs\":" << runs
+                << ",\"runs_by_length\":[";
+            size_t top = runs_by_length.size();
+            while (top > 0 && runs_by_length[top - 1] == 0) {
+                --top;
+            }
+            for (size_t i = 0; i < top; ++i) {
+                out << (i ? "," : "") << runs_by_length[i];
+            }
+            out << "],\"passes\":[";
+            for (size_t i = 0; i < passes.size(); ++i) {
+                out << (i ? "," : "") << "{\"merges\":" << passes[i].merges << ",\"bytes\":" << passes[i].bytes << "}";
+            }
+            out << "],\"scratch_bytes\":" << scratch_bytes
+                << ",\"waited\":" << waited
+                << ",\"phases\":{";
+            bool first = true;
+            for (size_t p = 0; p < SORT_PHASES; ++p) {
+                Phase const &ref = phases[p];
+                if (ref.calls == 0) {
+                    continue;
+                }
+                out << (first ? "" : ",") << "\"" << phase_name(sort_phase(p)) << "\":{\"calls\":" << ref.calls
+                    << ",\"wall\":" << ref.wall << ",\"cpu\":" << ref.cpu;
+                if (ref.cache_misses >= 0) {
+                    out << ",\"cache_misses\":" << ref.cache_misses;
+                }
+                out << "}";
+                first = false;
+            }
+            out << "}}";
+            return out.str();
+        }
+    };
+
+} // namespace my
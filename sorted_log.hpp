@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "timsort.hpp"
+
+namespace my {
+
+    // A sorted multiset that grows in batches. Each batch is sorted on its
+    // own and pushed as a run; runs are merged only as timsort's stack
+    // invariants demand (each run longer than the next, and than the next
+    // two together), so there are O(log n) of them and every element is
+    // merged O(log n) times. Queries and iteration read across the pending
+    // runs without merging them. Equal elements keep their insertion order.
+    // Appending invalidates iterators.
+    template<class Ty, class Cmp = std::less<Ty>>
+    class sorted_log {
+        // [first, last) offsets into data, so runs survive reallocation.
+        struct Run {
+            size_t first;
+            size_t last;
+
+            size_t size() const {
+                return last - first;
+            }
+        };
+        using Iter = typename std::vector<Ty>::iterator;
+        std::vector<Ty> data;
+        std::vector<Run> runs;
+        Cmp cmp;
+        timsort<Iter, Cmp> tim;
+        scratch arena;
+        gallop_state state;
+
+    public:
+        // Walks the runs in merged order, a k-way merge over their heads.
+        // On ties the older run goes first.
+        class const_iterator {
+            friend sorted_log;
+            static size_t const NONE = SIZE_MAX;
+            sorted_log const *log{nullptr};
+            // Next unread offset of every run.
+            std::vector<size_t> pos;
+            // The run whose head is the current element, NONE at the end.
+            size_t cur{NONE};
+
+            const_iterator(sorted_log const *log, std::vector<size_t> pos) : log(log), pos(std::move(pos)) {
+                settle();
+            }
+
+            void settle() {
+                cur = NONE;
+                for (size_t r = 0; r < pos.size(); ++r) {
+                    if (pos[r] < log->runs[r].last
+                        && (cur == NONE || log->cmp(log->data[pos[r]], log->data[pos[cur]]))) {
+                        cur = r;
+                    }
+                }
+            }
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Ty;
+            using difference_type = ptrdiff_t;
+            using pointer = Ty const *;
+            using reference = Ty const &;
+
+            const_iterator() = default;
+
+            reference operator*() const {
+                return log->data[pos[cur]];
+            }
+
+            pointer operator->() const {
+                return &log->data[pos[cur]];
+            }
+
+            const_iterator &operator++() {
+                ++pos[cur];
+                settle();
+                return *this;
+            }
+
+            const_iterator operator++(int) {
+                const_iterator tmp = *this;
+                ++*this;
+                return tmp;
+            }
+
+            bool operator==(const_iterator const &other) const {
+                if (cur == NONE || other.cur == NONE) {
+                    return cur == other.cur;
+                }
+                return pos[cur] == other.pos[other.cur];
+            }
+
+            bool operator!=(const_iterator const &other) const {
+                return !(*this == other);
+            }
+        };
+
+        explicit sorted_log(Cmp cmp = {}, thread_pool &pool = thread_pool::instance()) : cmp(cmp), tim(pool) {
+        }
+
+        // Sorts [first, last) on its own, pushes it as a new run and
+        // settles whatever merges the stack invariants then call for.
+        template<class InputIt>
+        void append(InputIt first, InputIt last) {
+            size_t start = data.size();
+            data.insert(data.end(), first, last);
+            if (data.size() == start) {
+                return;
+            }
+            tim.sort(data.begin() + start, data.end(), cmp);
+            runs.push_back(Run{start, data.size()});
+            collapse();
+        }
+
+        size_t size() const {
+            return data.size();
+        }
+
+        bool empty() const {
+            return data.empty();
+        }
+
+        // Runs still waiting to be merged.
+        size_t run_count() const {
+            return runs.size();
+        }
+
+        const_iterator begin() const {
+            std::vector<size_t> pos(runs.size());
+            for (size_t r = 0; r < runs.size(); ++r) {
+                pos[r] = runs[r].first;
+            }
+            return const_iterator(this, std::move(pos));
+        }
+
+        const_iterator end() const {
+            return const_iterator();
+        }
+
+        // The first element not less than key, searched in every run.
+        const_iterator lower_bound(Ty const &key) const {
+            std::vector<size_t> pos(runs.size());
+            for (size_t r = 0; r < runs.size(); ++r) {
+                pos[r] = std::lower_bound(data.begin() + runs[r].first, data.begin() + runs[r].last, key, cmp)
+                         - data.begin();
+            }
+            return const_iterator(this, std::move(pos));
+        }
+
+        // The first element greater than key, searched in every run.
+        const_iterator upper_bound(Ty const &key) const {
+            std::vector<size_t> pos(runs.size());
+            for (size_t r = 0; r < runs.size(); ++r) {
+                pos[r] = std::upper_bound(data.begin() + runs[r].first, data.begin() + runs[r].last, key, cmp)
+                         - data.begin();
+            }
+            return const_iterator(this, std::move(pos));
+        }
+
+        // A sorted copy of everything; the log itself stays as it is.
+        std::vector<Ty> flatten() const {
+            std::vector<Ty> out(data);
+            std::vector<Run> stack(runs);
+            scratch buf;
+            gallop_state gallop;
+            merge_all(out, stack, buf, gallop);
+            return out;
+        }
+
+        // Merges every pending run, after which the log is one sorted array.
+        void compact() {
+            merge_all(data, runs, arena, state);
+        }
+
+    private:
+        // timsort's merge_collapse: restores |A| > |B| + |C| and |B| > |C|
+        // for the three runs at the top of the stack.
+        void collapse() {
+            while (runs.size() > 1) {
+                size_t n = runs.size() - 2;
+                if ((n > 0 && runs[n - 1].size() <= runs[n].size() + runs[n + 1].size())
+                    || (n > 1 && runs[n - 2].size() <= runs[n - 1].size() + runs[n].size())) {
+                    if (runs[n - 1].size() < runs[n + 1].size()) {
+                        --n;
+                    }
+                } else if (runs[n].size() > runs[n + 1].size()) {
+                    break;
+                }
+                merge_at(data, runs, n, arena, state);
+            }
+        }
+
+        void merge_at(std::vector<Ty> &vec, std::vector<Run> &stack, size_t n, scratch &buf,
+                      gallop_state &gallop) const {
+            Run &left = stack[n];
+            Run const &right = stack[n + 1];
+            buf.reserve(sizeof(Ty) * std::min(left.size(), right.size()));
+            Iter base = vec.begin();
+            merge(base + left.first, base + left.last, base + right.last, cmp, buf.data<Ty>(), gallop);
+            left.last = right.last;
+            stack.erase(stack.begin() + n + 1);
+        }
+
+        // Top down, so every merge is between runs of growing length.
+        void merge_all(std::vector<Ty> &vec, std::vector<Run> &stack, scratch &buf, gallop_state &gallop) const {
+            while (stack.size() > 1) {
+                merge_at(vec, stack, stack.size() - 2, buf, gallop);
+            }
+        }
+    };
+
+} // namespace my
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "thread_pool.hpp"
+#include "type_traits.hpp"
+
+namespace my {
+
+    ptrdiff_t const STRING_INSERTION_THRESHOLDS = 16;
+    ptrdiff_t const STRING_PARALLEL_THRESHOLDS = 1 << 14;
+
+    // std::string and std::string_view under std::less.
+    template<class Ty, class Cmp>
+    constexpr bool use_string_sort_v = is_less<Ty, Cmp>::value
+                                       && (std::is_same<Ty, std::string>::value
+                                           || std::is_same<Ty, std::string_view>::value);
+
+    // One string being sorted: its bytes; the length of the prefix it
+    // shares with the item before it in its sorted run; the 8 bytes from
+    // that offset as a big-endian integer, zero padded, so most comparisons
+    // are one integer compare; and its position in the input.
+    struct string_item {
+        uint64_t cache;
+        char const *data;
+        size_t size;
+        size_t lcp;
+        size_t index;
+    };
+
+    inline uint64_t load_big_endian(char const *ptr) {
+        uint64_t bits;
+        std::memcpy(&bits, ptr, sizeof(bits));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        bits = __builtin_bswap64(bits);
+#endif
+        return bits;
+    }
+
+    // Points the item's cache at offset lcp.
+    inline void string_recache(string_item &item, size_t lcp) {
+        item.lcp = lcp;
+        if (lcp + 8 <= item.size) {
+            item.cache = load_big_endian(item.data + lcp);
+        } else {
+            char bytes[8] = {};
+            if (lcp < item.size) {
+                std::memcpy(bytes, item.data + lcp, item.size - lcp);
+            }
+            item.cache = load_big_endian(bytes);
+        }
+    }
+
+    inline string_item make_string_item(std::string_view str, size_t index) {
+        string_item item{0, str.data(), str.size(), 0, index};
+        string_recache(item, 0);
+        return item;
+    }
+
+    // Three-way compare of two strings known to agree on their first h
+    // bytes, reading from h on; h is left at the length of their common
+    // prefix. Bytes compare unsigned and a proper prefix orders first, as
+    // std::string does.
+    inline int string_compare_bytes(string_item const &a, string_item const &b, size_t &h) {
+        size_t len = std::min(a.size, b.size);
+        for (; h + 8 <= len; h += 8) {
+            uint64_t x = load_big_endian(a.data + h);
+            uint64_t y = load_big_endian(b.data + h);
+            if (x != y) {
+                h += __builtin_clzll(x ^ y) / 8;
+                return x < y ? -1 : 1;
+            }
+        }
+        for (; h < len; ++h) {
+            if (a.data[h] != b.data[h]) {
+                return (unsigned char) a.data[h] < (unsigned char) b.data[h] ? -1 : 1;
+            }
+        }
+        return a.size < b.size ? -1 : a.size > b.size;
+    }
+
+    // As string_compare_bytes, for two items whose caches both start at h:
+    // the cached words settle the order unless they are equal.
+    inline int string_compare(string_item const &a, string_item const &b, size_t &h) {
+        if (a.cache != b.cache) {
+            h = std::min({h + __builtin_clzll(a.cache ^ b.cache) / 8, a.size, b.size});
+            return a.cache < b.cache ? -1 : 1;
+        }
+        h = std::min({h + 8, a.size, b.size});
+        return string_compare_bytes(a, b, h);
+    }
+
+    // Stable insertion sort of items whose caches start at 0. Afterwards
+    // every item holds its LCP with its predecessor for the merges.
+    inline void lcp_insertion_sort(string_item *first, string_item *last) {
+        for (string_item *it = first + 1; it < last; ++it) {
+            string_item tmp = *it;
+            string_item *pos = it;
+            for (; pos > first; --pos) {
+                size_t h = 0;
+                if (string_compare(tmp, pos[-1], h) >= 0) {
+                    break;
+                }
+                pos[0] = pos[-1];
+            }
+            *pos = tmp;
+        }
+        for (string_item *it = last - 1; it > first; --it) {
+            size_t h = 0;
+            string_compare(it[-1], *it, h);
+            string_recache(*it, h);
+        }
+    }
+
+    // Merges sorted runs [a, a_last) and [b, b_last) into out. A head's lcp is its LCP with the last item
+    // written (a run's first item has 0): the head sharing more with it is
+    // the smaller, so only ties are compared, from their common LCP on, and
+    // the head that stays has its LCP and cache moved up to what the two
+    // share. Every item written thus carries its LCP with the one before.
+    inline void lcp_merge(string_item *a, string_item *a_last,
+                          string_item *b, string_item *b_last, string_item *out) {
+        while (a < a_last && b < b_last) {
+            bool take_a;
+            if (a->lcp != b->lcp) {
+                take_a = a->lcp > b->lcp;
+            } else {
+                size_t h = a->lcp;
+                take_a = string_compare(*a, *b, h) <= 0;
+                string_item &rest = take_a ? *b : *a;
+                if (rest.lcp != h) {
+                    string_recache(rest, h);
+                }
+            }
+            *out++ = take_a ? *a++ : *b++;
+        }
+        out = std::copy(a, a_last, out);
+        std::copy(b, b_last, out);
+    }
+
+    // Stable LCP merge sort of [first, last) into itself, or into buf
+    // (holding as many items) when `into_buf`. The halves are sorted into
+    // the other array so each level merges straight across and nothing is
+    // copied back. Halves above STRING_PARALLEL_THRESHOLDS are sorted
+    // concurrently.
+    inline void lcp_merge_sort(string_item *first, string_item *last, string_item *buf, thread_pool &pool,
+                               bool into_buf = false) {
+        ptrdiff_t len = last - first;
+        if (len <= STRING_INSERTION_THRESHOLDS) {
+            if (len > 0) {
+                lcp_insertion_sort(first, last);
+            }
+            if (into_buf) {
+                std::copy(first, last, buf);
+            }
+            return;
+        }
+        ptrdiff_t half = len / 2;
+        if (len >= STRING_PARALLEL_THRESHOLDS && pool.size() > 0) {
+            // A group of its own: the pool's implicit one is shared with the
+            // recursive call below, whose wait() would then also wait for
+            // the half posted here.
+            task_group group(pool);
+            group.run([=, &pool] { lcp_merge_sort(first, first + half, buf, pool, !into_buf); });
+            lcp_merge_sort(first + half, last, buf + half, pool, !into_buf);
+            group.wait();
+        } else {
+            lcp_merge_sort(first, first + half, buf, pool, !into_buf);
+            lcp_merge_sort(first + half, last, buf + half, pool, !into_buf);
+        }
+        string_item *src = into_buf ? first : buf;
+        string_item *dst = into_buf ? buf : first;
+        size_t h = 0;
+        if (string_compare_bytes(src[half - 1], src[half], h) <= 0) {
+            string_recache(src[half], h);
+            std::copy(src, src + len, dst);
+            return;
+        }
+        lcp_merge(src, src + half, src + half, src + len, dst);
+    }
+
+} // namespace my
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace my {
+
+    // Move-only `void()` callable. Callables up to INLINE_SIZE bytes live in
+    // the object itself, larger ones fall back to the heap.
+    class task {
+    public:
+        static constexpr size_t INLINE_SIZE = 64;
+
+    private:
+        struct ops {
+            void (*call)(void *);
+            void (*move)(void *, void *);
+            void (*destroy)(void *);
+        };
+
+        template<class F>
+        static constexpr bool fits = sizeof(F) <= INLINE_SIZE
+                                     && alignof(F) <= alignof(std::max_align_t)
+                                     && std::is_nothrow_move_constructible<F>::value;
+
+        template<class F>
+        static ops const *inline_ops() {
+            static ops const table{
+                    [](void *ptr) { (*static_cast<F *>(ptr))(); },
+                    [](void *dst, void *src) {
+                        new(dst) F(std::move(*static_cast<F *>(src)));
+                        static_cast<F *>(src)->~F();
+                    },
+                    [](void *ptr) { static_cast<F *>(ptr)->~F(); },
+            };
+            return &table;
+        }
+
+        template<class F>
+        static ops const *heap_ops() {
+            static ops const table{
+                    [](void *ptr) { (**static_cast<F **>(ptr))(); },
+                    [](void *dst, void *src) { new(dst) F *(*static_cast<F **>(src)); },
+                    [](void *ptr) { delete *static_cast<F **>(ptr); },
+            };
+            return &table;
+        }
+
+        alignas(std::max_align_t) unsigned char buf[INLINE_SIZE];
+        ops const *table{nullptr};
+
+    public:
+        task() = default;
+
+        template<class F, class = std::enable_if_t<!std::is_same<std::decay_t<F>, task>::value>>
+        task(F &&fun) {
+            emplace(std::forward<F>(fun));
+        }
+
+        task(task &&other) noexcept {
+            take(other);
+        }
+
+        task &operator=(task &&other) noexcept {
+            if (this != &other) {
+                reset();
+                take(other);
+            }
+            return *this;
+        }
+
+        task(task const &) = delete;
+
+        task &operator=(task const &) = delete;
+
+        ~task() {
+            reset();
+        }
+
+        template<class F>
+        void emplace(F &&fun) {
+            using type = std::decay_t<F>;
+            reset();
+            if constexpr (fits<type>) {
+                new(buf) type(std::forward<F>(fun));
+                table = inline_ops<type>();
+            } else {
+                new(buf) type *(new type(std::forward<F>(fun)));
+                table = heap_ops<type>();
+            }
+        }
+
+        explicit operator bool() const {
+            return table != nullptr;
+        }
+
+        void operator()() {
+            table->call(buf);
+        }
+
+        void reset() {
+            if (table != nullptr) {
+                table->destroy(buf);
+                table = nullptr;
+            }
+        }
+
+    private:
+        void take(task &other) {
+            if (other.table != nullptr) {
+                other.table->move(buf, other.buf);
+                table = other.table;
+                other.table = nullptr;
+            }
+        }
+    };
+
+} // namespace my
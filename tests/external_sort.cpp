@@ -0,0 +1,122 @@
+// External sorts that need several chunks and merge passes, on a pool
+// with no workers and from inside a task on a pool with one, where every
+// read-ahead has to be run by the thread waiting for it. Also budgets
+// under a merge block and an output that is the input.
+//   g++ -std=c++17 -O2 -pthread -I. tests/external_sort.cpp
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "external_sort.hpp"
+
+struct record {
+    int key;
+    int index;
+};
+
+struct by_key {
+    bool operator()(record const &a, record const &b) const {
+        return a.key < b.key;
+    }
+};
+
+std::string const dir = "/tmp";
+std::string const input = dir + "/external_sort_test_in." + std::to_string(getpid());
+std::string const output = dir + "/external_sort_test_out." + std::to_string(getpid());
+
+std::vector<record> make_input(size_t len) {
+    std::mt19937 mt_rand{uint32_t(len)};
+    std::vector<record> data(len);
+    for (size_t n = 0; n < len; ++n) {
+        data[n] = record{int(mt_rand() % 1000), int(n)};
+    }
+    my::file out(input, O_WRONLY | O_CREAT | O_TRUNC);
+    out.write(data.data(), len * sizeof(record), 0);
+    std::stable_sort(data.begin(), data.end(), by_key());
+    return data;
+}
+
+bool matches(std::vector<record> const &expect) {
+    my::file in(output, O_RDONLY);
+    std::vector<record> got(in.size() / sizeof(record));
+    in.read(got.data(), got.size() * sizeof(record), 0);
+    return got.size() == expect.size() && std::equal(got.begin(), got.end(), expect.begin(), [](auto &a, auto &b) {
+        return a.key == b.key && a.index == b.index;
+    });
+}
+
+bool sorts(my::thread_pool &pool, size_t len, size_t budget, bool mmap) {
+    std::vector<record> expect = make_input(len);
+    my::external_sort<record, by_key> sorter(budget, pool);
+    sorter.set_temp_dir(dir);
+    sorter.use_mmap_output(mmap);
+    sorter.sort(input, output);
+    bool ok = matches(expect);
+    if (!ok) {
+        std::printf("len %zu, budget %zu, mmap %d: wrong output\n", len, budget, int(mmap));
+    }
+    return ok;
+}
+
+bool all_sizes(my::thread_pool &pool) {
+    bool ok = true;
+    for (bool mmap : {false, true}) {
+        // One chunk, a few runs merged at once, many runs over several
+        // passes, and a budget above a merge block.
+        ok &= sorts(pool, 1000, 1 << 16, mmap);
+        ok &= sorts(pool, 20000, 1 << 16, mmap);
+        ok &= sorts(pool, 200000, 1 << 16, mmap);
+        ok &= sorts(pool, 300000, 3 << 20, mmap);
+    }
+    return ok;
+}
+
+bool onto_itself() {
+    make_input(100);
+    my::external_sort<record, by_key> sorter(1 << 16);
+    try {
+        sorter.sort(input, input);
+    } catch (std::invalid_argument const &) {
+        return my::file(input, O_RDONLY).size() == 100 * sizeof(record);
+    }
+    return false;
+}
+
+// Fails the test instead of hanging it.
+template<class Fun>
+bool within(char const *name, Fun fun) {
+    auto result = std::async(std::launch::async, fun);
+    if (result.wait_for(std::chrono::seconds(120)) != std::future_status::ready) {
+        std::printf("%s: timed out\n", name);
+        std::fflush(stdout);
+        std::_Exit(1);
+    }
+    bool ok = result.get();
+    if (!ok) {
+        std::printf("%s: failed\n", name);
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    my::thread_pool none(0);
+    ok &= within("no workers", [&] { return all_sizes(none); });
+    my::thread_pool one(1);
+    ok &= within("in a task on one worker", [&] { return one.add([&] { return all_sizes(one); }).get(); });
+    my::thread_pool four(4);
+    ok &= within("four workers", [&] { return all_sizes(four); });
+    ok &= within("output is the input", onto_itself);
+    ::unlink(input.c_str());
+    ::unlink(output.c_str());
+    std::puts(ok ? "external_sort: ok" : "external_sort: FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+// Runs of equal length that end at the end of their array, merged through
+// the loser tree directly and through timsort's multiway passes. Build
+// with -fsanitize=address to catch reads past the last run:
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -pthread -I. tests/multiway_merge.cpp
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "timsort.hpp"
+
+int main() {
+    std::mt19937 mt_rand{7};
+    int failures = 0;
+    for (size_t k : {2, 3, 4, 7, 16}) {
+        for (ptrdiff_t len : {1, 15, 16, 17, 100}) {
+            for (bool banded : {false, true}) {
+                // Banded: run i holds only keys above those of run i - 1, so
+                // the last run, the one ending at the array's end, runs dry
+                // first under std::greater.
+                std::vector<int> input(k * len);
+                for (size_t n = 0; n < input.size(); ++n) {
+                    input[n] = banded ? int(n / len * 1000 + mt_rand() % 50) : int(mt_rand() % 50);
+                }
+                std::vector<int const *> first(k);
+                std::vector<int const *> last(k);
+                for (size_t i = 0; i < k; ++i) {
+                    std::sort(input.begin() + i * len, input.begin() + (i + 1) * len, std::greater<int>());
+                    first[i] = input.data() + i * len;
+                    last[i] = first[i] + len;
+                }
+                std::unique_ptr<int[]> out(new int[input.size()]);
+                my::multiway_merge(first.data(), last.data(), k, out.get(), std::greater<int>());
+                std::vector<int> expect(input);
+                std::stable_sort(expect.begin(), expect.end(), std::greater<int>());
+                failures += !std::equal(expect.begin(), expect.end(), out.get());
+            }
+        }
+    }
+    for (int threads : {0, 4}) {
+        my::thread_pool pool(threads);
+        std::vector<int> data(1 << 18);
+        ptrdiff_t run = ptrdiff_t(data.size()) / 8;
+        for (size_t n = 0; n < data.size(); ++n) {
+            data[n] = int(n / run * 1000000 + mt_rand() % 1000000);
+        }
+        for (auto it = data.begin(); it < data.end(); it += run) {
+            std::sort(it, it + run, std::greater<int>());
+        }
+        std::vector<int> expect(data);
+        std::sort(expect.begin(), expect.end(), std::greater<int>());
+        my::timsort<std::vector<int>::iterator, std::greater<int>> tim(pool);
+        tim.use_multiway(true);
+        tim.use_radix(false);
+        tim.set_parallel_merge_threshold(1 << 10);
+        tim.sort(data.begin(), data.end(), std::greater<int>());
+        failures += data != expect;
+    }
+    std::printf(failures ? "multiway_merge: FAILED\n" : "multiway_merge: ok\n");
+    return failures != 0;
+}
@@ -0,0 +1,62 @@
+// A task that sorts on the pool it runs on: the sort's own post() / wait()
+// must only wait for what the sort posted, not for the task around it,
+// which the outer wait() may be running inline on the same thread.
+//   g++ -std=c++17 -O2 -pthread -I. tests/nested_wait.cpp
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "timsort.hpp"
+
+bool nested_sort(my::thread_pool &pool, bool radix) {
+    std::mt19937 mt_rand{11};
+    std::vector<int> data(1 << 18);
+    for (int &x : data) {
+        x = int(mt_rand());
+    }
+    std::vector<int> expect(data);
+    std::sort(expect.begin(), expect.end());
+    auto done = pool.add([&] {
+        my::timsort<std::vector<int>::iterator> tim(pool);
+        tim.use_radix(radix);
+        tim.set_parallel_merge_threshold(1 << 10);
+        tim.sort(data.begin(), data.end());
+    });
+    pool.wait();
+    done.get();
+    return data == expect;
+}
+
+// Tasks that post and wait on their own, two levels deep.
+bool nested_posts(my::thread_pool &pool) {
+    std::atomic<int> count{0};
+    for (int i = 0; i < 4; ++i) {
+        pool.post([&] {
+            for (int j = 0; j < 4; ++j) {
+                pool.post([&] {
+                    for (int k = 0; k < 4; ++k) {
+                        pool.post([&] { ++count; });
+                    }
+                    pool.wait();
+                });
+            }
+            pool.wait();
+        });
+    }
+    pool.wait();
+    return count == 64;
+}
+
+int main() {
+    int failures = 0;
+    my::thread_pool single(1);
+    my::thread_pool none(0);
+    for (my::thread_pool *pool : {&single, &none, &my::thread_pool::instance()}) {
+        failures += !nested_sort(*pool, true);
+        failures += !nested_sort(*pool, false);
+        failures += !nested_posts(*pool);
+    }
+    std::printf(failures ? "nested_wait: FAILED\n" : "nested_wait: ok\n");
+    return failures != 0;
+}
@@ -0,0 +1,76 @@
+// A wait() whose group's tasks sit under other tasks on the same deque:
+// posts nobody waits for yet, or the jobs of other threads outside the
+// pool, which all share one deque. With no free worker the waiter itself
+// has to run them to get at its own.
+//   g++ -std=c++17 -O2 -pthread -I. tests/pool_wait.cpp
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// A group task between two posts nobody waits for.
+bool buried(my::thread_pool &pool) {
+    std::atomic<int> count{0};
+    my::task_group group(pool);
+    pool.post([&] { count += 1; });
+    group.run([&] { count += 10; });
+    pool.post([&] { count += 1; });
+    group.wait();
+    bool ok = count >= 10;
+    pool.wait();
+    return ok && count == 12;
+}
+
+// Threads outside the pool interleaving their groups on the shared deque.
+bool interleaved(my::thread_pool &pool) {
+    std::atomic<int> count{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int round = 0; round < 200; ++round) {
+                my::task_group group(pool);
+                for (int n = 0; n < 8; ++n) {
+                    group.run([&] { count += 1; });
+                }
+                group.wait();
+            }
+        });
+    }
+    for (std::thread &th : threads) {
+        th.join();
+    }
+    return count == 4 * 200 * 8;
+}
+
+// Fails the test instead of hanging it.
+template<class Fun>
+bool within(char const *name, Fun fun) {
+    auto result = std::async(std::launch::async, fun);
+    if (result.wait_for(std::chrono::seconds(60)) != std::future_status::ready) {
+        std::printf("%s: timed out\n", name);
+        std::fflush(stdout);
+        std::_Exit(1);
+    }
+    bool ok = result.get();
+    if (!ok) {
+        std::printf("%s: failed\n", name);
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    my::thread_pool none(0);
+    ok &= within("buried, no workers", [&] { return buried(none); });
+    ok &= within("interleaved, no workers", [&] { return interleaved(none); });
+    my::thread_pool one(1);
+    ok &= within("buried, in a task on one worker", [&] { return one.add([&] { return buried(one); }).get(); });
+    ok &= within("interleaved, one worker", [&] { return interleaved(one); });
+    std::puts(ok ? "pool_wait: ok" : "pool_wait: FAILED");
+    return ok ? 0 : 1;
+}
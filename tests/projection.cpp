@@ -0,0 +1,77 @@
+// Projected sorts take their key comparator per call, like
+// std::ranges::sort: one sorter orders records by keys of another type
+// and still sorts them by its own Cmp, with and without the key cache.
+//   g++ -std=c++17 -O2 -pthread -I. tests/projection.cpp
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "timsort.hpp"
+
+struct record {
+    int id;
+    std::string name;
+    double weight;
+
+    bool operator<(record const &other) const {
+        return id < other.id;
+    }
+};
+
+std::vector<record> make_records(size_t len) {
+    std::mt19937 mt_rand{7};
+    std::vector<record> data(len);
+    for (size_t n = 0; n < len; ++n) {
+        data[n] = record{int(n), std::to_string(mt_rand() % 100), double(mt_rand() % 50)};
+    }
+    return data;
+}
+
+template<class KeyCmp, class Proj>
+bool matches(std::vector<record> const &got, std::vector<record> expect, KeyCmp cmp, Proj proj) {
+    std::stable_sort(expect.begin(), expect.end(), [&](record const &a, record const &b) {
+        return cmp(std::invoke(proj, a), std::invoke(proj, b));
+    });
+    return std::equal(got.begin(), got.end(), expect.begin(), [](record const &a, record const &b) {
+        return a.id == b.id;
+    });
+}
+
+template<class Stats>
+bool by_keys(my::thread_pool &pool, size_t len) {
+    bool ok = true;
+    std::vector<record> input = make_records(len);
+    for (bool cache : {false, true}) {
+        my::timsort<std::vector<record>::iterator, std::less<record>, Stats> tim(pool);
+        tim.use_key_cache(cache);
+        std::vector<record> data(input);
+
+        tim.sort(data.begin(), data.end(), std::greater<double>(), &record::weight);
+        ok &= matches(data, input, std::greater<double>(), &record::weight);
+
+        auto name = [](record const &r) -> std::string const & { return r.name; };
+        std::vector<record> before(data);
+        tim.sort(data.begin(), data.end(), {}, name);
+        ok &= matches(data, before, std::less<>(), name);
+
+        tim.sort(data.begin(), data.end());
+        ok &= std::is_sorted(data.begin(), data.end());
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    my::thread_pool none(0);
+    my::thread_pool four(4);
+    for (size_t len : {100, 5000, 200000}) {
+        ok &= by_keys<my::no_stats>(none, len);
+        ok &= by_keys<my::no_stats>(four, len);
+        ok &= by_keys<my::sort_stats>(four, len);
+    }
+    std::puts(ok ? "projection: ok" : "projection: FAILED");
+    return ok ? 0 : 1;
+}
@@ -1,17 +1,66 @@
 #pragma once
+#include <algorithm>
+#include <condition_variable>
 #include <functional>
 #include <future>
+#include <memory>
 #include <mutex>
 #include <random>
 #include <thread>
 #include <vector>
 
-#include "cuque.hpp"
+#include "task.hpp"
 #include "type_traits.hpp"
+#include "ws_deque.hpp"
 
 namespace my {
 
 	class thread_pool;
+	class task_group;
+	class job_slab;
+
+	struct job {
+		my::task fun;
+		task_group* group { nullptr };
+		job* next { nullptr };
+		job_slab* home { nullptr };
+	};
+
+	// Recycles job nodes. Only the owning thread takes nodes; any thread may
+	// give one back, onto a lock-free list the owner drains in one exchange.
+	// Memory is only allocated while the slab is still warming up.
+	class job_slab {
+		static size_t const CHUNK = 256;
+		job* local { nullptr };
+		std::atomic<job*> remote { nullptr };
+		std::vector<std::unique_ptr<job[]>> chunks;
+
+	public:
+		job* get()
+		{
+			if (local == nullptr) {
+				local = remote.exchange(nullptr, std::memory_order_acquire);
+			}
+			if (local == nullptr) {
+				chunks.emplace_back(new job[CHUNK]);
+				for (size_t i = 0; i < CHUNK; ++i) {
+					chunks.back()[i].home = this;
+					chunks.back()[i].next = local;
+					local = &chunks.back()[i];
+				}
+			}
+			job* ptr = local;
+			local = ptr->next;
+			return ptr;
+		}
+		void put(job* ptr)
+		{
+			job* head = remote.load(std::memory_order_relaxed);
+			do {
+				ptr->next = head;
+			} while (!remote.compare_exchange_weak(head, ptr, std::memory_order_release, std::memory_order_relaxed));
+		}
+	};
 
 	class worker {
 		friend thread_pool;
@@ -21,28 +70,17 @@ namespace my {
 			off,
 		};
 		std::thread th;
-		std::mutex mtx;
-		std::condition_variable cnd;
+		thread_pool* host { nullptr };
 		std::atomic_int signal { on };
 		std::atomic_int status { null };
-		my::cuque<std::function<void()>> task;
-
-	public:
-		template <class F, class... Args>
-		std::future<my::invoke_result_t<F, Args...>> add(F&& fun, Args&&... args)
-		{
-			using type = std::packaged_task<my::invoke_result_t<F, Args...>()>;
-			auto task_ptr = std::make_shared<type>(std::bind(std::forward<F>(fun), std::forward<Args>(args)...));
-			task.emplace_back([=] { (*task_ptr)(); });
-			cnd.notify_one();
-			return task_ptr->get_future();
-		}
+		my::ws_deque<job*> task;
+		job_slab slab;
 
 	private:
-		void work(thread_pool* host, std::shared_ptr<worker> _this);
-		void free() {
+		void work();
+		void free()
+		{
 			signal = off;
-			cnd.notify_one();
 		}
 
 	public:
@@ -54,94 +92,301 @@ namespace my {
 		}
 	};
 
+	// Fork-join scope. Tasks started with run() belong to the group; wait()
+	// runs queued tasks until the group's own are done, the calling
+	// thread's newest first, which is where its group's tasks sit, then
+	// anything it can steal. It only parks once there is nothing left to
+	// run anywhere. Groups nest: a task may open its own group and wait on
+	// it.
+	class task_group {
+		friend thread_pool;
+		thread_pool& host;
+		// One reference belongs to wait() itself, so whoever drops the count
+		// to zero knows the waiter is parked and has to wake it.
+		std::atomic_size_t pending { 1 };
+		std::mutex mtx;
+		std::condition_variable cnd;
+		bool done { false };
+
+		void finish()
+		{
+			if (pending.fetch_sub(1) == 1) {
+				std::unique_lock<std::mutex> lock(mtx);
+				done = true;
+				cnd.notify_all();
+			}
+		}
+
+	public:
+		explicit task_group(thread_pool& pool);
+		task_group(task_group const&) = delete;
+		task_group& operator=(task_group const&) = delete;
+		~task_group()
+		{
+			wait();
+		}
+
+		template <class F>
+		void run(F&& fun);
+		void wait();
+	};
+
 	class thread_pool {
 		friend worker;
-		std::mt19937 mt_rand { std::random_device {}() };
-		std::mutex mtx;
+		friend task_group;
 		std::vector<std::shared_ptr<worker>> pool;
-		std::atomic_size_t count { 0 };
+		// Threads outside the pool share one deque; the mutex serialises its
+		// owner end, thieves still take from the top without it.
+		std::mutex mtx;
+		my::ws_deque<job*> external;
+		job_slab slab;
+		std::atomic_size_t queued { 0 };
+		std::atomic_size_t sleepers { 0 };
+		std::mutex park_mtx;
+		std::condition_variable park_cnd;
+
+		static worker*& current()
+		{
+			static thread_local worker* ptr = nullptr;
+			return ptr;
+		}
 
 	public:
+		// Shared by the whole process, one worker per hardware thread.
+		static thread_pool& instance()
+		{
+			static thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+			return pool;
+		}
+
 		size_t size()
 		{
-			std::unique_lock<std::mutex> lock(mtx);
 			return pool.size();
 		}
 
 	private:
-		int get_rand()
+		static size_t get_rand(size_t n)
 		{
-			std::unique_lock<std::mutex> lock(mtx);
-			std::uniform_int_distribution<> dis(0, (int)pool.size() - 1);
-			return dis(mt_rand);
+			static thread_local std::minstd_rand mt_rand { std::random_device {}() };
+			return std::uniform_int_distribution<size_t>(0, n - 1)(mt_rand);
 		}
-		bool task_take(std::function<void()>& ref)
+		// The calling thread's own deque, if it is one of our workers.
+		worker* self()
 		{
-			return pool[get_rand()]->task.pull_front(ref);
+			worker* ptr = current();
+			return ptr != nullptr && ptr->host == this ? ptr : nullptr;
 		}
-		void scheduler()
+		// How many tasks the calling thread is inside, counting the ones a
+		// wait() runs inline.
+		static size_t& depth()
 		{
-			std::function<void()> fun;
-			if (task_take(fun)) {
-				pool[get_rand()]->task.emplace_front(std::move(fun));
+			static thread_local size_t n = 0;
+			return n;
+		}
+		// What add() / wait() track: everything this thread added here at
+		// its current depth. A task gets a group of its own, so a wait()
+		// inside it never counts the task itself or what its caller added.
+		task_group& implicit()
+		{
+			static thread_local std::vector<std::pair<size_t, std::unique_ptr<task_group>>> groups;
+			size_t level = depth();
+			for (auto& ref : groups) {
+				if (ref.first == level && &ref.second->host == this) {
+					return *ref.second;
+				}
 			}
+			groups.emplace_back(level, new task_group(*this));
+			return *groups.back().second;
+		}
+		template <class F>
+		void submit(F&& fun, task_group* group)
+		{
+			if (worker* ptr = self()) {
+				job* node = ptr->slab.get();
+				node->fun.emplace(std::forward<F>(fun));
+				node->group = group;
+				ptr->task.push(node);
+			}
+			else {
+				std::unique_lock<std::mutex> lock(mtx);
+				job* node = slab.get();
+				node->fun.emplace(std::forward<F>(fun));
+				node->group = group;
+				external.push(node);
+			}
+			queued += 1;
+			if (sleepers != 0) {
+				std::unique_lock<std::mutex> lock(park_mtx);
+				park_cnd.notify_one();
+			}
+		}
+		bool steal(job*& ref)
+		{
+			size_t n = pool.size() + 1;
+			size_t start = get_rand(n);
+			for (size_t i = 0; i < n; ++i) {
+				size_t k = (start + i) % n;
+				if (k == pool.size() ? external.steal(ref) : pool[k]->task.steal(ref)) {
+					return true;
+				}
+			}
+			return false;
+		}
+		// The calling thread's newest task, or any other thread's oldest.
+		bool task_take(job*& ref)
+		{
+			worker* ptr = self();
+			bool own;
+			if (ptr != nullptr) {
+				own = ptr->task.pop(ref);
+			}
+			else {
+				std::unique_lock<std::mutex> lock(mtx);
+				own = external.pop(ref);
+			}
+			if (own || steal(ref)) {
+				queued -= 1;
+				return true;
+			}
+			return false;
+		}
+		static void run(job* fun)
+		{
+			task_group* group = fun->group;
+			depth() += 1;
+			fun->fun();
+			depth() -= 1;
+			fun->fun.reset();
+			fun->home->put(fun);
+			group->finish();
 		}
 
 	public:
 		template <class F, class... Args>
 		std::future<my::invoke_result_t<F, Args...>> add(F&& fun, Args&&... args)
 		{
-			count += 1;
-			auto result = pool[get_rand()]->add(std::forward<F>(fun), std::forward<Args>(args)...);
-			scheduler();
+			using type = std::packaged_task<my::invoke_result_t<F, Args...>()>;
+			type task(std::bind(std::forward<F>(fun), std::forward<Args>(args)...));
+			auto result = task.get_future();
+			implicit().run([task = std::move(task)]() mutable { task(); });
 			return result;
 		}
+		// Fire and forget: no future and, once the slabs are warm, no heap
+		// allocation when the callable fits my::task's inline storage.
+		template <class F>
+		void post(F&& fun)
+		{
+			implicit().run(std::forward<F>(fun));
+		}
+		// Waits for the tasks this thread started with add() or post() in
+		// the task it is running, or outside any task.
 		void wait()
 		{
-			while (count != 0) {
-				std::function<void()> fun;
-				if (task_take(fun)) {
-					fun();
-					count -= 1;
-				}
-				else {
-					std::this_thread::yield();
-				}
-			}
+			implicit().wait();
 		}
 		explicit thread_pool(size_t n)
 		{
 			for (size_t i = 0; i < n; ++i) {
-				auto ptr = std::make_shared<worker>();
-				std::thread([=] {ptr->work(this, ptr); }).detach();
-				pool.emplace_back(std::move(ptr));
+				pool.emplace_back(std::make_shared<worker>());
+			}
+			for (auto& ptr : pool) {
+				worker* raw = ptr.get();
+				raw->host = this;
+				raw->th = std::thread([=] { raw->work(); });
 			}
 		}
 		~thread_pool()
 		{
-			std::unique_lock<std::mutex> lock(mtx);
 			for (auto& ptr : pool) {
 				ptr->free();
 			}
+			{
+				std::unique_lock<std::mutex> lock(park_mtx);
+				park_cnd.notify_all();
+			}
+			for (auto& ptr : pool) {
+				ptr->th.join();
+			}
+		}
+	};
+
+	inline task_group::task_group(thread_pool& pool)
+		: host(pool)
+	{
+	}
+
+	template <class F>
+	void task_group::run(F&& fun)
+	{
+		pending += 1;
+		host.submit(std::forward<F>(fun), this);
+	}
+
+	inline void task_group::wait()
+	{
+		if (pending == 1) {
+			return;
+		}
+		// Whatever is queued may be what the group waits on, directly or
+		// not: a task of its own under someone else's, or one a task of
+		// its own waits for. Nothing else may run it on a pool without
+		// free workers.
+		job* fun;
+		while (pending > 1 && host.task_take(fun)) {
+			thread_pool::run(fun);
+		}
+		if (pending.fetch_sub(1) != 1) {
+			std::unique_lock<std::mutex> lock(mtx);
+			cnd.wait(lock, [&] { return done; });
+		}
+		pending = 1;
+		done = false;
+	}
+
+	// What parallel_for waits with unless told otherwise.
+	struct group_wait {
+		void wait(task_group& group) const
+		{
+			group.wait();
 		}
 	};
 
-	void worker::work(thread_pool* host, std::shared_ptr<worker> _this)
+	// Calls fun(t) for every t in [0, parts): fun(0) on the calling thread,
+	// the others as tasks of a group of their own, and returns once all of
+	// them have. `waiter.wait(group)` does the waiting, so a caller can time
+	// it.
+	template <class F, class Waiter = group_wait>
+	void parallel_for(thread_pool& pool, ptrdiff_t parts, F const& fun, Waiter&& waiter = {})
 	{
+		task_group group(pool);
+		for (ptrdiff_t t = 1; t < parts; ++t) {
+			group.run([&fun, t] { fun(t); });
+		}
+		if (parts > 0) {
+			fun(0);
+		}
+		waiter.wait(group);
+	}
+
+	inline void worker::work()
+	{
+		thread_pool::current() = this;
 		status = on;
 		while (on == signal) {
-			std::unique_lock<std::mutex> lock(mtx);
-			std::function<void()> fun;
-			if (task.pull_front(fun)) {
-				fun();
-				host->count -= 1;
+			job* fun;
+			if (host->task_take(fun)) {
+				thread_pool::run(fun);
+				continue;
 			}
-			else {
-				cnd.wait(lock);
+			std::unique_lock<std::mutex> lock(host->park_mtx);
+			host->sleepers += 1;
+			if (host->queued == 0 && on == signal) {
+				host->park_cnd.wait(lock);
 			}
+			host->sleepers -= 1;
 		}
 		status = off;
-		_this.reset();
+		thread_pool::current() = nullptr;
 	}
 
 } // namespace my
@@ -1,220 +1,1290 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <vector>
 
+#include "presortedness.hpp"
 #include "print.hpp"
+#include "radix_sort.hpp"
+#include "run_scan.hpp"
+#include "sample_sort.hpp"
+#include "scratch.hpp"
+#include "string_sort.hpp"
+#include "small_sort.hpp"
+#include "sort_stats.hpp"
 #include "thread_pool.hpp"
 
 namespace my {
 
-    template<class Iter,
-            class Cmp = std::less<typename std::iterator_traits<Iter>::value_type>>
-    void insert_sort(Iter first, Iter last, Cmp cmp = Cmp{}) {
-        for (Iter for_x = first + 1; for_x < last; ++for_x) {
-            Iter for_y = for_x;
-            auto tmp = for_y[0];
-            for (; first < for_y && cmp(tmp, for_y[-1]); --for_y) {
-                for_y[0] = for_y[-1];
+    template<class Iter>
+    using buffer_t = typename std::iterator_traits<Iter>::value_type *;
+
+    // Trivially copyable elements in contiguous storage move as raw bytes.
+    template<class Iter>
+    constexpr bool is_bitwise_v = is_contiguous_iterator_v<Iter>
+                                  && std::is_trivially_copyable<typename std::iterator_traits<Iter>::value_type>::value;
+
+    // Moves [first, last) into raw scratch at `out`, constructing each element.
+    template<class Iter>
+    void move_construct(Iter first, Iter last, buffer_t<Iter> out) {
+        using value_type = typename std::iterator_traits<Iter>::value_type;
+        if constexpr (is_bitwise_v<Iter>) {
+            if (first != last) {
+                std::memcpy(out, std::addressof(*first), sizeof(value_type) * (last - first));
+            }
+        } else {
+            for (; first != last; ++first, ++out) {
+                new(out) value_type(std::move(*first));
+            }
+        }
+    }
+
+    // Moves [first, last) onto the live elements starting at `out`, which
+    // may overlap the source from below. Returns the end of the output.
+    template<class From, class To>
+    To move_assign(From first, From last, To out) {
+        using value_type = typename std::iterator_traits<To>::value_type;
+        if constexpr (is_bitwise_v<From> && is_bitwise_v<To>) {
+            ptrdiff_t len = last - first;
+            if (len != 0) {
+                std::memmove(std::addressof(*out), std::addressof(*first), sizeof(value_type) * len);
+            }
+            return out + len;
+        } else {
+            for (; first != last; ++first, ++out) {
+                *out = std::move(*first);
             }
-            for_y[0] = tmp;
+            return out;
         }
     }
 
+    // Moves [first, last) onto the live elements ending at `out`, which may
+    // overlap the source from above. Returns the start of the output.
+    template<class From, class To>
+    To move_assign_backward(From first, From last, To out) {
+        using value_type = typename std::iterator_traits<To>::value_type;
+        if constexpr (is_bitwise_v<From> && is_bitwise_v<To>) {
+            ptrdiff_t len = last - first;
+            if (len != 0) {
+                std::memmove(std::addressof(*(out - len)), std::addressof(*first), sizeof(value_type) * len);
+            }
+            return out - len;
+        } else {
+            while (first != last) {
+                *--out = std::move(*--last);
+            }
+            return out;
+        }
+    }
+
+    // Ends the objects a merge constructed in scratch.
+    template<class Ty>
+    void destroy(Ty *first, Ty *last) {
+        if constexpr (!std::is_trivially_destructible<Ty>::value) {
+            for (; first != last; ++first) {
+                first->~Ty();
+            }
+        }
+    }
+
+    // std::rotate, through scratch when the shorter side fits in `cap`
+    // elements at `buf`. Returns where *first ends up.
+    template<class Iter>
+    Iter buffered_rotate(Iter first, Iter div, Iter last, buffer_t<Iter> buf, ptrdiff_t cap) {
+        ptrdiff_t n1 = div - first;
+        ptrdiff_t n2 = last - div;
+        if (n1 == 0 || n2 == 0 || std::min(n1, n2) > cap) {
+            return std::rotate(first, div, last);
+        }
+        if (n1 <= n2) {
+            move_construct(first, div, buf);
+            move_assign(div, last, first);
+            move_assign(buf, buf + n1, first + n2);
+            destroy(buf, buf + n1);
+        } else {
+            move_construct(div, last, buf);
+            move_assign_backward(first, div, last);
+            move_assign(buf, buf + n2, first);
+            destroy(buf, buf + n2);
+        }
+        return first + n2;
+    }
+
+    ptrdiff_t const MIN_GALLOP = 7;
+
+    // Carried across the merges of one task: the adaptive gallop threshold,
+    // the comparisons galloping saved, counted against the one comparison
+    // per placed element the plain merge loop would spend, and the elements
+    // moved, into the buffer and back into place.
+    struct gallop_state {
+        ptrdiff_t min_gallop = MIN_GALLOP;
+        ptrdiff_t saved = 0;
+        ptrdiff_t moved = 0;
+    };
+
+    // Length of the prefix of [0, n) on which `pred` holds, found by
+    // exponential search followed by binary search.
+    template<class Pred>
+    ptrdiff_t gallop(ptrdiff_t n, Pred pred) {
+        ptrdiff_t lo = 0;
+        ptrdiff_t ofs = 1;
+        while (ofs <= n && pred(ofs - 1)) {
+            lo = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        ptrdiff_t hi = std::min(ofs - 1, n);
+        while (lo < hi) {
+            ptrdiff_t mid = lo + ((hi - lo) >> 1);
+            if (pred(mid)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // `buf` must have room for div - first elements.
     template<class Iter, class Cmp>
-    void merge_left(Iter first, Iter div, Iter last, Cmp cmp) {
+    void merge_left(Iter first, Iter div, Iter last, Cmp cmp, buffer_t<Iter> buf, gallop_state &state) {
         using value_type = typename std::iterator_traits<Iter>::value_type;
-        using pointer = typename std::iterator_traits<Iter>::pointer;
+        using pointer = buffer_t<Iter>;
         ptrdiff_t len = div - first;
-        auto ptr = (pointer) malloc(sizeof(value_type) * len);
-        pointer _first = ptr;
+        pointer _first = buf;
         pointer _last = _first + len;
-        for (; len-- != 0;) {
-            new(std::addressof(_first[len])) value_type(std::move(first[len]));
-        }
+        move_construct(first, div, buf);
+        Iter const start = div;
+        ptrdiff_t min_gallop = state.min_gallop;
+        ptrdiff_t calls = 0;
+        auto counted = [&](value_type const &left, value_type const &right) {
+            ++calls;
+            return cmp(left, right);
+        };
+        ptrdiff_t count_a = 0;
+        ptrdiff_t count_b = 0;
         while (div < last && _first < _last) {
             if (cmp(div[0], _first[0])) {
-                new(std::addressof(*first++)) value_type(std::move(*div++));
+                *first++ = std::move(*div++);
+                count_a = 0;
+                if (++count_b < min_gallop) {
+                    continue;
+                }
             } else {
-                new(std::addressof(*first++)) value_type(std::move(*_first++));
+                *first++ = std::move(*_first++);
+                count_b = 0;
+                if (++count_a < min_gallop) {
+                    continue;
+                }
             }
+            // One run keeps winning: search for the end of its streak.
+            do {
+                if (div == last || _first == _last) {
+                    break;
+                }
+                calls = 0;
+                count_a = gallop(_last - _first, [&](ptrdiff_t i) { return !counted(div[0], _first[i]); });
+                first = move_assign(_first, _first + count_a, first);
+                _first += count_a;
+                state.saved += count_a + (_first != _last) - calls;
+                if (_first == _last) {
+                    break;
+                }
+                *first++ = std::move(*div++);
+                if (div == last) {
+                    break;
+                }
+                calls = 0;
+                count_b = gallop(last - div, [&](ptrdiff_t i) { return counted(div[i], _first[0]); });
+                first = move_assign(div, div + count_b, first);
+                div += count_b;
+                state.saved += count_b + (div != last) - calls;
+                if (div == last) {
+                    break;
+                }
+                *first++ = std::move(*_first++);
+                min_gallop -= min_gallop > 1;
+            } while (count_a >= MIN_GALLOP || count_b >= MIN_GALLOP);
+            min_gallop += 1;
+            count_a = 0;
+            count_b = 0;
         }
-        while (_first < _last) {
-            new(std::addressof(*first++)) value_type(std::move(*_first++));
-        }
-        free(ptr);
+        state.min_gallop = min_gallop;
+        state.moved += 2 * len + (div - start);
+        move_assign(_first, _last, first);
+        destroy(buf, buf + len);
     }
 
+    // `buf` must have room for last - div elements.
     template<class Iter, class Cmp>
-    void merge_right(Iter first, Iter div, Iter last, Cmp cmp) {
+    void merge_right(Iter first, Iter div, Iter last, Cmp cmp, buffer_t<Iter> buf, gallop_state &state) {
         using value_type = typename std::iterator_traits<Iter>::value_type;
-        using pointer = typename std::iterator_traits<Iter>::pointer;
+        using pointer = buffer_t<Iter>;
         ptrdiff_t len = last - div;
-        auto ptr = (pointer) malloc(sizeof(value_type) * len);
-        pointer _first = ptr;
+        pointer _first = buf;
         pointer _last = _first + len;
-        for (; len != 0; --len) {
-            new(std::addressof(_last[-len])) value_type(std::move(last[-len]));
-        }
+        move_construct(div, last, buf);
+        Iter const end = div;
+        ptrdiff_t min_gallop = state.min_gallop;
+        ptrdiff_t calls = 0;
+        auto counted = [&](value_type const &left, value_type const &right) {
+            ++calls;
+            return cmp(left, right);
+        };
+        ptrdiff_t count_a = 0;
+        ptrdiff_t count_b = 0;
         while (first < div && _first < _last) {
             if (cmp(_last[-1], div[-1])) {
-                new(std::addressof(*--last)) value_type(std::move(*--div));
+                *--last = std::move(*--div);
+                count_b = 0;
+                if (++count_a < min_gallop) {
+                    continue;
+                }
             } else {
-                new(std::addressof(*--last)) value_type(std::move(*--_last));
+                *--last = std::move(*--_last);
+                count_a = 0;
+                if (++count_b < min_gallop) {
+                    continue;
+                }
             }
+            // Same as merge_left, walking both runs from their ends.
+            do {
+                if (first == div || _first == _last) {
+                    break;
+                }
+                calls = 0;
+                count_a = gallop(div - first, [&](ptrdiff_t i) { return counted(_last[-1], div[-1 - i]); });
+                last = move_assign_backward(div - count_a, div, last);
+                div -= count_a;
+                state.saved += count_a + (first != div) - calls;
+                if (first == div) {
+                    break;
+                }
+                *--last = std::move(*--_last);
+                if (_first == _last) {
+                    break;
+                }
+                calls = 0;
+                count_b = gallop(_last - _first, [&](ptrdiff_t i) { return !counted(_last[-1 - i], div[-1]); });
+                last = move_assign_backward(_last - count_b, _last, last);
+                _last -= count_b;
+                state.saved += count_b + (_first != _last) - calls;
+                if (_first == _last) {
+                    break;
+                }
+                *--last = std::move(*--div);
+                min_gallop -= min_gallop > 1;
+            } while (count_a >= MIN_GALLOP || count_b >= MIN_GALLOP);
+            min_gallop += 1;
+            count_a = 0;
+            count_b = 0;
         }
-        while (_first < _last) {
-            new(std::addressof(*--last)) value_type(std::move(*--_last));
-        }
-        free(ptr);
+        state.min_gallop = min_gallop;
+        state.moved += 2 * len + (end - div);
+        move_assign_backward(_first, _last, last);
+        destroy(buf, buf + len);
     }
 
+    // Shrinks [first, last) to the part that actually needs merging.
+    // Returns false when nothing is left to do.
     template<class Iter, class Cmp>
-    void merge(Iter first, Iter div, Iter last, Cmp cmp) {
+    bool merge_bounds(Iter &first, Iter div, Iter &last, Cmp cmp, buffer_t<Iter> buf = nullptr, ptrdiff_t cap = 0) {
         while (first < div && !cmp(div[0], first[0])) {
             ++first;
         }
         while (div < last && !cmp(last[-1], div[-1])) {
             --last;
         }
+        if (first == div || div == last) {
+            return false;
+        }
         if (cmp(last[-1], first[0])) {
-            if (last - div < div - first) {
-                for (ptrdiff_t i = 0; i < last - div; ++i) {
-                    std::swap(first[0], div[i]);
-                    first += 1;
-                }
-            } else {
-                for (ptrdiff_t i = 1; i <= div - first; ++i) {
-                    last -= 1;
-                    std::swap(last[0], div[-i]);
-                }
-            }
+            // Every element of the right run is strictly smaller: a rotation
+            // keeps both runs in their own order, which keeps the sort stable.
+            buffered_rotate(first, div, last, buf, cap);
+            return false;
+        }
+        return true;
+    }
+
+    // `buf` must have room for the shorter of the two runs.
+    template<class Iter, class Cmp>
+    void merge(Iter first, Iter div, Iter last, Cmp cmp, buffer_t<Iter> buf, gallop_state &state) {
+        if (!merge_bounds(first, div, last, cmp, buf, PTRDIFF_MAX)) {
+            return;
         }
         if (last - div < div - first) {
-            merge_right(first, div, last, cmp);
+            merge_right(first, div, last, cmp, buf, state);
         } else {
-            merge_left(first, div, last, cmp);
+            merge_left(first, div, last, cmp, buf, state);
         }
     }
 
-    ptrdiff_t const INSERT_THRESHOLDS = 64;
+    // Stable merge with room for only `cap` elements at `buf`. While the
+    // shorter run does not fit, both runs are cut around the middle of the
+    // longer one, the inner pieces are rotated into place and the two halves
+    // merged on their own. The smaller the room the deeper the recursion;
+    // with none at all this is a plain rotation merge in O(n log n).
+    template<class Iter, class Cmp>
+    void bounded_merge(Iter first, Iter div, Iter last, Cmp cmp, buffer_t<Iter> buf, ptrdiff_t cap,
+                       gallop_state &state) {
+        while (std::min(div - first, last - div) > cap) {
+            if (!merge_bounds(first, div, last, cmp, buf, cap)) {
+                return;
+            }
+            ptrdiff_t n1 = div - first;
+            ptrdiff_t n2 = last - div;
+            if (std::min(n1, n2) <= cap) {
+                break;
+            }
+            Iter cut1, cut2;
+            if (n1 > n2) {
+                cut1 = first + n1 / 2;
+                cut2 = std::lower_bound(div, last, *cut1, cmp);
+            } else {
+                cut2 = div + n2 / 2;
+                cut1 = std::upper_bound(first, div, *cut2, cmp);
+            }
+            Iter mid = buffered_rotate(cut1, div, cut2, buf, cap);
+            if (mid - first < last - mid) {
+                bounded_merge(first, cut1, mid, cmp, buf, cap, state);
+                first = mid;
+                div = cut2;
+            } else {
+                bounded_merge(mid, cut2, last, cmp, buf, cap, state);
+                div = cut1;
+                last = mid;
+            }
+        }
+        if (first < div && div < last) {
+            merge(first, div, last, cmp, buf, state);
+        }
+    }
 
-    template<class Iter,
-            class Cmp = std::less<typename std::iterator_traits<Iter>::value_type>>
-    void merge_sort(Iter first, Iter last, Cmp cmp = {}) {
+    // Merge path: the number of elements taken from `a` among the first `k`
+    // elements of the stable merge of `a` and `b`. Ties go to `a`.
+    template<class Iter, class Cmp>
+    ptrdiff_t co_rank(ptrdiff_t k, Iter a, ptrdiff_t na, Iter b, ptrdiff_t nb, Cmp cmp) {
+        ptrdiff_t lo = std::max<ptrdiff_t>(0, k - nb);
+        ptrdiff_t hi = std::min(k, na);
+        while (lo < hi) {
+            ptrdiff_t i = lo + ((hi - lo) >> 1);
+            if (!cmp(b[k - i - 1], a[i])) {
+                lo = i + 1;
+            } else {
+                hi = i;
+            }
+        }
+        return lo;
+    }
+
+    template<class Iter, class Cmp, class Ptr>
+    void merge_into(Iter a, Iter a_last, Iter b, Iter b_last, Ptr out, Cmp cmp) {
+        using value_type = typename std::iterator_traits<Iter>::value_type;
+        while (a < a_last && b < b_last) {
+            if (cmp(b[0], a[0])) {
+                new(std::addressof(*out++)) value_type(std::move(*b++));
+            } else {
+                new(std::addressof(*out++)) value_type(std::move(*a++));
+            }
+        }
+        while (a < a_last) {
+            new(std::addressof(*out++)) value_type(std::move(*a++));
+        }
+        while (b < b_last) {
+            new(std::addressof(*out++)) value_type(std::move(*b++));
+        }
+    }
+
+    ptrdiff_t const PARALLEL_MERGE_THRESHOLDS = 1 << 16;
+    // Inputs at least this long are scanned for runs in one chunk per thread.
+    ptrdiff_t const PARALLEL_SCAN_THRESHOLDS = 1 << 16;
+
+    // A multiway merge keeps about four cache lines per way hot (the run's
+    // head and its path through the tree); the ways of one pass should fit
+    // the L2 cache.
+    size_t const L2_CACHE_BYTES = 1 << 20;
+    size_t const MULTIWAY_WAYS = L2_CACHE_BYTES / (4 * 64);
+    // Below this many runs the pairwise merges, which gallop, are kept.
+    size_t const MULTIWAY_MIN_RUNS = 4;
+
+    // Stable merge of the k runs [first[i], last[i]) into raw storage at
+    // `out` through a loser tree: log2(k) comparisons per element and one
+    // pass over memory. Ties go to the run with the lower index.
+    template<class Iter, class Cmp>
+    void multiway_merge(Iter const *first, Iter const *last, size_t k, buffer_t<Iter> out, Cmp cmp) {
+        using value_type = typename std::iterator_traits<Iter>::value_type;
+        // Batches shorter than this take the checked path instead.
+        ptrdiff_t const BATCH = 16;
+        std::vector<Iter> cur;
+        std::vector<Iter> end;
+        for (size_t i = 0; i < k; ++i) {
+            cur.push_back(first[i]);
+            end.push_back(last[i]);
+        }
+        std::vector<size_t> tree;
+        // The higher run wins a match only when strictly less. In checked
+        // mode exhausted runs lose every match.
+        auto winner = [&](auto checked, size_t a, size_t b) {
+            size_t lo = std::min(a, b);
+            size_t hi = std::max(a, b);
+            if (checked) {
+                if (cur[hi] == end[hi]) {
+                    return lo;
+                }
+                if (cur[lo] == end[lo]) {
+                    return hi;
+                }
+            }
+            return cmp(*cur[hi], *cur[lo]) ? hi : lo;
+        };
+        // Node n > 0 holds the loser of the match between its children 2n
+        // and 2n + 1, leaves sit at k + i and node 0 holds the winner.
+        auto build = [&](auto &self, size_t node) -> size_t {
+            if (node >= k) {
+                return node - k;
+            }
+            size_t a = self(self, node * 2);
+            size_t b = self(self, node * 2 + 1);
+            size_t win = winner(std::false_type{}, a, b);
+            tree[node] = a ^ b ^ win;
+            return win;
+        };
+        auto step = [&](auto checked) {
+            size_t win = tree[0];
+            new(std::addressof(*out++)) value_type(std::move(*cur[win]++));
+            for (size_t node = (win + k) >> 1; node != 0; node >>= 1) {
+                size_t other = tree[node];
+                size_t next = winner(checked, other, win);
+                tree[node] = other ^ win ^ next;
+                win = next;
+            }
+            tree[0] = win;
+        };
+        while (true) {
+            // Drop exhausted runs; the survivors keep their order.
+            size_t live = 0;
+            for (size_t i = 0; i < k; ++i) {
+                if (cur[i] != end[i]) {
+                    cur[live] = cur[i];
+                    end[live] = end[i];
+                    ++live;
+                }
+            }
+            k = live;
+            if (k < 2) {
+                for (; k == 1 && cur[0] != end[0]; ++cur[0]) {
+                    new(std::addressof(*out++)) value_type(std::move(*cur[0]));
+                }
+                return;
+            }
+            tree.assign(k, 0);
+            tree[0] = build(build, 1);
+            // No run can run dry within the first batch - 1 steps, so those
+            // need no exhaustion checks; the last step of a batch may empty
+            // a run and replays checked. Once one is close, step checked
+            // instead and rebuild without it when it is gone.
+            while (true) {
+                ptrdiff_t batch = end[0] - cur[0];
+                for (size_t i = 1; i < k; ++i) {
+                    batch = std::min(batch, ptrdiff_t(end[i] - cur[i]));
+                }
+                if (batch == 0) {
+                    break;
+                }
+                if (batch >= BATCH) {
+                    for (; batch != 1; --batch) {
+                        step(std::false_type{});
+                    }
+                    step(std::true_type{});
+                } else {
+                    for (ptrdiff_t n = 0; n < BATCH && cur[tree[0]] != end[tree[0]]; ++n) {
+                        step(std::true_type{});
+                    }
+                }
+            }
+        }
+    }
+
+    // Multi-sequence selection: cuts the runs [first[i], last[i]) at
+    // split[i] so that exactly `rank` elements of their stable merge come
+    // before the cuts. O(k^2 log^2 n) comparisons.
+    template<class Iter, class Cmp>
+    void multiway_split(ptrdiff_t rank, Iter const *first, Iter const *last, size_t k, Iter *split, Cmp cmp) {
+        // Position of first[r][n] in the merged output.
+        auto position = [&](size_t r, ptrdiff_t n) {
+            Iter it = first[r] + n;
+            ptrdiff_t count = n;
+            for (size_t i = 0; i < k; ++i) {
+                if (i < r) {
+                    count += std::upper_bound(first[i], last[i], *it, cmp) - first[i];
+                } else if (i > r) {
+                    count += std::lower_bound(first[i], last[i], *it, cmp) - first[i];
+                }
+            }
+            return count;
+        };
+        for (size_t r = 0; r < k; ++r) {
+            ptrdiff_t lo = 0;
+            ptrdiff_t hi = last[r] - first[r];
+            while (lo < hi) {
+                ptrdiff_t mid = lo + ((hi - lo) >> 1);
+                if (position(r, mid) < rank) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            split[r] = first[r] + lo;
+        }
+    }
+
+    // `buf` must have room for min(cap, (last - first) / 2) elements.
+    template<class Iter, class Cmp>
+    void merge_sort(Iter first, Iter last, Cmp cmp, buffer_t<Iter> buf, gallop_state &state,
+                    ptrdiff_t cap = PTRDIFF_MAX) {
         ptrdiff_t len = last - first;
         if (INSERT_THRESHOLDS < len) {
             len /= 3;
             Iter left = first + len;
             Iter right = last - len;
 
-            merge_sort(first, left, cmp);
-            merge_sort(left, right, cmp);
-            merge_sort(right, last, cmp);
+            merge_sort(first, left, cmp, buf, state, cap);
+            merge_sort(left, right, cmp, buf, state, cap);
+            merge_sort(right, last, cmp, buf, state, cap);
 
             if (!cmp(left[0], left[-1]) && !cmp(right[0], right[-1])) {
                 // Orderly
             } else if (cmp(right[-1], first[0]) && cmp(last[-1], left[0])) {
-                while (len-- != 0) {
-                    std::swap(first[len], right[len]);
+                // The outer thirds trade places.
+                if (len <= cap) {
+                    move_construct(first, left, buf);
+                    move_assign(right, last, first);
+                    move_assign(buf, buf + len, right);
+                    destroy(buf, buf + len);
+                } else {
+                    std::swap_ranges(first, left, right);
                 }
             } else {
-                merge(left, right, last, cmp);
-                merge(first, left, last, cmp);
+                bounded_merge(left, right, last, cmp, buf, cap, state);
+                bounded_merge(first, left, last, cmp, buf, cap, state);
             }
         } else {
-            insert_sort(first, last, cmp);
+            small_sort(first, last, cmp);
         }
     }
 
     template<class Iter,
             class Cmp = std::less<typename std::iterator_traits<Iter>::value_type>>
+    void merge_sort(Iter first, Iter last, Cmp cmp = {}) {
+        using value_type = typename std::iterator_traits<Iter>::value_type;
+        scratch arena;
+        arena.reserve(sizeof(value_type) * ((last - first) / 2 + 1));
+        gallop_state state;
+        merge_sort(first, last, cmp, arena.data<value_type>(), state);
+    }
+
+    // Orders elements by the keys `proj` extracts from them.
+    template<class Cmp, class Proj>
+    struct projected_cmp {
+        Cmp cmp;
+        Proj proj;
+
+        template<class Left, class Right>
+        bool operator()(Left &&left, Right &&right) const {
+            return cmp(std::invoke(proj, std::forward<Left>(left)), std::invoke(proj, std::forward<Right>(right)));
+        }
+    };
+
+    // A cached key and the position of the element it was taken from.
+    template<class Key, class Index>
+    struct keyed {
+        Key key;
+        Index index;
+    };
+
+    template<class Cmp>
+    struct keyed_cmp {
+        Cmp cmp;
+
+        template<class Ty>
+        bool operator()(Ty const &left, Ty const &right) const {
+            return cmp(left.key, right.key);
+        }
+    };
+
+    // How timsort picks which neighbouring runs to merge.
+    enum class merge_policy {
+        // Munro & Wild's Powersort: merge cost within O(n) of optimal.
+        powersort,
+        // The original size heuristic, merged level by level.
+        classic,
+    };
+
+    // What timsort::sort does with an input.
+    enum class sort_strategy {
+        // Picked per input from estimate_presortedness.
+        automatic,
+        // Find the natural runs and merge them.
+        merge,
+        // LSD radix sort of integer and float keys.
+        radix,
+        // LCP merge sort of std::string / std::string_view.
+        strings,
+        // Parallel sample sort.
+        sample,
+        // Sample sort with an equality bucket for every sampled key, so
+        // one distribution pass places most elements.
+        few_unique,
+    };
+
+    // Automatic selection merges when sampled runs average at least this
+    // long, and takes the few-unique path when at most 1 / FEW_UNIQUE_RATIO
+    // of the sampled elements are distinct.
+    ptrdiff_t const NATURAL_RUN_LENGTH = 16;
+    ptrdiff_t const FEW_UNIQUE_RATIO = 4;
+    ptrdiff_t const FEW_UNIQUE_THRESHOLDS = 1 << 14;
+    // Shorter inputs are merged without an estimate.
+    ptrdiff_t const ESTIMATE_THRESHOLDS = 1 << 8;
+
+    // Powersort node power of the boundary between the runs [s1, s1 + n1)
+    // and [s1 + n1, s1 + n1 + n2) of a range of n: the first bit in which
+    // the two midpoints, as fractions of n, differ.
+    inline int node_power(ptrdiff_t s1, ptrdiff_t n1, ptrdiff_t n2, ptrdiff_t n) {
+        int power = 0;
+        ptrdiff_t a = 2 * s1 + n1;
+        ptrdiff_t b = a + n1 + n2;
+        while (true) {
+            ++power;
+            if (a >= n) {
+                a -= n;
+                b -= n;
+            } else if (b >= n) {
+                break;
+            }
+            a <<= 1;
+            b <<= 1;
+        }
+        return power;
+    }
+
+    // Stats is no_stats or sort_stats (see sort_stats.hpp).
+    template<class Iter,
+            class Cmp = std::less<typename std::iterator_traits<Iter>::value_type>,
+            class Stats = no_stats>
     class timsort {
+        template<class, class, class> friend class timsort;
+        using value_type = typename std::iterator_traits<Iter>::value_type;
         using reference = typename std::iterator_traits<Iter>::reference;
+        using pointer = buffer_t<Iter>;
+        // What the comparison engines call: Cmp, counted with statistics on.
+        using compare = std::conditional_t<Stats::enabled, counted_cmp<Cmp>, Cmp>;
         struct Run {
             Iter first;
             Iter last;
+            // Number of pending merges this run waits on in the current pass.
+            size_t depth = 0;
         };
         using Container = std::vector<Run>;
-        thread_pool pool{3};
+        struct Merge {
+            Iter first;
+            Iter div;
+            Iter last;
+            size_t depth;
+        };
+        using Schedule = std::vector<Merge>;
+        // A run found by scanning one chunk on its own. An open run reaches
+        // the end of its chunk and may go on into the next.
+        struct Candidate {
+            Iter first;
+            Iter last;
+            bool descending;
+            bool open;
+        };
+        struct Chunk {
+            Iter first;
+            Iter last;
+            std::vector<Candidate> runs;
+            size_t next = 0;
+        };
+        // A run on the Powersort stack and the power of its right boundary.
+        struct Pending {
+            Run run;
+            int power;
+        };
+        thread_pool &pool;
+        ptrdiff_t merge_threshold = PARALLEL_MERGE_THRESHOLDS;
+        scratch arena;
+        // Every range [a, b) being sorted or merged by a task owns the arena
+        // slice starting at (a - origin) >> shift, so concurrent tasks on
+        // disjoint ranges never share scratch. shift is 1 when the arena
+        // holds n / 2 elements and 0 when merge path needs all n.
+        Iter origin;
+        int shift = 1;
+        std::atomic<ptrdiff_t> saved{0};
+        bool radix = true;
+        bool key_cache = false;
+        bool strings = true;
+        bool sample = false;
+        bool multiway = false;
+        size_t budget = SIZE_MAX;
+        merge_policy policy = merge_policy::powersort;
+        sort_strategy strategy = sort_strategy::automatic;
+        sort_strategy chosen = sort_strategy::merge;
+        presortedness estimate;
+        ptrdiff_t merged = 0;
+        Stats counters;
 
     public:
+        explicit timsort(thread_pool &pool = thread_pool::instance()) : pool(pool) {
+        }
+
         ~timsort() = default;
 
+        // Merges at least this long are split by merge path across the pool.
+        void set_parallel_merge_threshold(ptrdiff_t n) {
+            merge_threshold = n;
+        }
+
+        // Back the scratch arena with huge pages (mmap + MADV_HUGEPAGE).
+        void use_huge_pages(bool on) {
+            arena.use_huge_pages(on);
+        }
+
+        // Sort with a caller-owned scratch buffer. A buffer of
+        // sizeof(value_type) * n bytes covers every path, n / 2 elements are
+        // enough below the parallel merge threshold. If it turns out too
+        // small the arena allocates its own storage instead.
+        void use_buffer(void *buf, size_t bytes) {
+            arena.assign(buf, bytes);
+        }
+
+        // Comparisons galloping avoided during the last sort().
+        ptrdiff_t comparisons_saved() const {
+            return saved;
+        }
+
+        // Caps the scratch the sorter allocates. Tasks get a proportional
+        // share of it; merges whose shorter run does not fit their share
+        // fall back to rotations (see bounded_merge), so less memory costs
+        // time rather than failing. Radix and multiway merging need n
+        // elements and are skipped under a smaller budget; the key cache
+        // always needs its n keys.
+        void set_memory_budget(size_t bytes) {
+            budget = bytes;
+            if (arena.capacity() > bytes) {
+                arena.release();
+            }
+        }
+
+        void use_merge_policy(merge_policy on) {
+            policy = on;
+        }
+
+        // Summed length of the merges the last sort() scheduled, the cost
+        // a merge policy minimises. Each element merged is moved about twice.
+        ptrdiff_t elements_merged() const {
+            return merged;
+        }
+
+        // Integer and float keys under std::less / std::greater are radix
+        // sorted unless this is turned off.
+        void use_radix(bool on) {
+            radix = on;
+        }
+
+        // std::string / std::string_view under std::less are sorted as
+        // (8-byte prefix, pointer) items by an LCP merge sort unless this is
+        // turned off.
+        void use_string_mode(bool on) {
+            strings = on;
+        }
+
+        // Inputs without long runs or few keys go to a parallel stable
+        // sample sort (see sample_sort), which partitions by splitters in one pass
+        // per level instead of merging log2(n) times. Needs n elements of
+        // scratch; off by default, the run engine wins on anything with
+        // structure.
+        void use_sample_sort(bool on) {
+            sample = on;
+        }
+
+        // Takes `on` for every input instead of choosing per input. An
+        // input that cannot take it (radix or strings on other key types,
+        // or past the memory budget) is merged.
+        void use_strategy(sort_strategy on) {
+            strategy = on;
+        }
+
+        // The strategy sort() would take for [first, last) now; the
+        // estimate it was based on is left in last_presortedness().
+        sort_strategy choose_strategy(Iter const first, Iter const last, Cmp const cmp = {}) {
+            ptrdiff_t len = last - first;
+            estimate = presortedness();
+            if (strategy != sort_strategy::automatic) {
+                return can_take(strategy, len) ? strategy : sort_strategy::merge;
+            }
+            // Which strategies the key type, the comparator, the length and
+            // the switches leave open; the estimate is only worth its
+            // comparisons if one of them is.
+            bool const to_radix = radix && len >= RADIX_THRESHOLDS && can_take(sort_strategy::radix, len);
+            bool const to_strings = strings && can_take(sort_strategy::strings, len);
+            bool const to_few_unique = len >= FEW_UNIQUE_THRESHOLDS && can_take(sort_strategy::few_unique, len);
+            bool const to_sample = sample && len >= SAMPLE_SORT_THRESHOLDS && can_take(sort_strategy::sample, len);
+            if (len < ESTIMATE_THRESHOLDS || !(to_radix || to_strings || to_few_unique || to_sample)) {
+                return sort_strategy::merge;
+            }
+            counters.start(sort_phase::estimate);
+            estimate = estimate_presortedness(first, last, counting(cmp));
+            counters.stop(sort_phase::estimate);
+            if (estimate.presorted || estimate.runs * NATURAL_RUN_LENGTH <= len) {
+                return sort_strategy::merge;
+            }
+            if (to_radix) {
+                return sort_strategy::radix;
+            }
+            if (to_strings) {
+                return sort_strategy::strings;
+            }
+            if (to_few_unique && estimate.distinct * FEW_UNIQUE_RATIO <= estimate.samples) {
+                return sort_strategy::few_unique;
+            }
+            if (to_sample) {
+                return sort_strategy::sample;
+            }
+            return sort_strategy::merge;
+        }
+
+        // The strategy the last sort() took.
+        sort_strategy last_strategy() const {
+            return chosen;
+        }
+
+        // The estimate behind the last choice; samples is 0 if none was made.
+        presortedness const &last_presortedness() const {
+            return estimate;
+        }
+
+        // What the last sort() recorded, with Stats = sort_stats.
+        Stats &stats() {
+            return counters;
+        }
+
+        Stats const &stats() const {
+            return counters;
+        }
+
+        // Projected sorts compute each key once and sort (key, index) pairs
+        // instead of calling the projection on every comparison and moving
+        // whole elements on every merge step.
+        void use_key_cache(bool on) {
+            key_cache = on;
+        }
+
+        // Merge MULTIWAY_MIN_RUNS or more runs up to MULTIWAY_WAYS at a time
+        // through a loser tree instead of pairwise: one pass over memory
+        // instead of log2(runs), for merges limited by memory bandwidth.
+        // Off by default; on one core the galloping pairwise merges win.
+        void use_multiway(bool on) {
+            multiway = on;
+        }
+
     private:
-        void merge_sort(Iter first, Iter last, Cmp cmp = {}) {
+        compare counting(Cmp const cmp) {
+            if constexpr (Stats::enabled) {
+                return compare{cmp, &counters.comparisons};
+            } else {
+                return cmp;
+            }
+        }
+
+        bool can_take(sort_strategy on, ptrdiff_t len) const {
+            switch (on) {
+                case sort_strategy::radix:
+                    return use_radix_v<value_type, Cmp> && is_contiguous_iterator_v<Iter> && fits(len);
+                case sort_strategy::strings:
+                    return use_string_sort_v<value_type, Cmp> && sizeof(string_item) * 2 * len <= budget;
+                case sort_strategy::sample:
+                case sort_strategy::few_unique:
+                    return fits(len);
+                default:
+                    return true;
+            }
+        }
+
+        pointer slice(Iter it) {
+            return arena.data<value_type>() + ((it - origin) >> shift);
+        }
+
+        // Elements of scratch owned by the range [first, last).
+        ptrdiff_t room(Iter first, Iter last) {
+            return ((last - origin) >> shift) - ((first - origin) >> shift);
+        }
+
+        bool fits(ptrdiff_t len) const {
+            return sizeof(value_type) * len <= budget;
+        }
+
+        // Under a memory budget the arena shrinks by further powers of two;
+        // past the last one every range owns no scratch at all.
+        void reserve(Iter const first, Iter const last) {
+            int const MAX_SHIFT = sizeof(ptrdiff_t) * 8 - 1;
+            ptrdiff_t len = last - first;
+            origin = first;
+            shift = len >= merge_threshold && pool.size() != 0 ? 0 : 1;
+            while (shift < MAX_SHIFT && !fits((len >> shift) + 1)) {
+                ++shift;
+            }
+            if (fits((len >> shift) + 1)) {
+                arena.reserve(sizeof(value_type) * ((len >> shift) + 1));
+            }
+        }
+
+        void merge_sort(Iter first, Iter last, compare cmp, pointer buf, gallop_state &state) {
             ptrdiff_t len = last - first;
             if (INSERT_THRESHOLDS < len) {
                 Iter div = first + (len >> 1);
-                merge_sort(first, div, cmp);
-                merge_sort(div, last, cmp);
-                merge(first, div, last, cmp);
+                merge_sort(first, div, cmp, buf, state);
+                merge_sort(div, last, cmp, buf, state);
+                merge(first, div, last, cmp, buf, state);
             } else {
-                insert_sort(first, last, cmp);
+                small_sort(first, last, cmp);
             }
         }
 
-        bool is_not_equal(reference left, reference right, Cmp const cmp) {
-            return cmp(left, right) || cmp(right, left);
+        void sort_task(Iter first, Iter last, compare cmp, pointer buf) {
+            gallop_state state;
+            my::merge_sort(first, last, cmp, buf, state, room(first, last));
+            saved += state.saved;
+            counters.count_moves(state.moved);
         }
 
-        bool is_equal(reference left, reference right, Cmp const cmp) {
-            return !is_not_equal(left, right, cmp);
+        void merge_task(Iter first, Iter div, Iter last, compare cmp, pointer buf) {
+            gallop_state state;
+            bounded_merge(first, div, last, cmp, buf, room(first, last), state);
+            saved += state.saved;
+            counters.count_moves(state.moved);
         }
 
-        void reverse_stable(Iter const first, Iter const last, Cmp const cmp) {
+        // Reverses a run descending under cmp, then restores the input order
+        // of each group of equal keys. The reversed run ascends, so a key
+        // differs from its successor exactly when it compares less.
+        void reverse_stable(Iter const first, Iter const last, compare const cmp) {
             std::reverse(first, last);
             for (Iter it = first; it < last;) {
-                while (it + 1 < last && is_not_equal(it[0], it[1], cmp)) {
+                while (it + 1 < last && cmp(it[0], it[1])) {
                     ++it;
                 }
                 Iter tmp = it;
                 if (it < last) {
                     do {
                         ++it;
-                    } while (it < last && is_equal(it[-1], it[0], cmp));
+                    } while (it < last && !cmp(it[-1], it[0]));
                 }
                 std::reverse(tmp, it);
             }
         }
 
+        // Settles the Powersort merges that the run after `top` decides:
+        // every pending boundary of higher power than the new one is merged
+        // first. The merges are only recorded in `schedule`.
+        void power_push(std::vector<Pending> &stack, Run &top, Run const &next, ptrdiff_t n, Schedule &schedule) {
+            int power = node_power(top.first - origin, top.last - top.first, next.last - next.first, n);
+            while (!stack.empty() && stack.back().power > power) {
+                top = join(schedule, stack.back().run, top);
+                stack.pop_back();
+            }
+            stack.push_back(Pending{top, power});
+            top = next;
+        }
+
+        // The run structure of one chunk as the serial scan would see it if
+        // a run started at the chunk's first element. Read only, so the
+        // chunks are scanned concurrently.
+        static void scan_chunk(Chunk &chunk, Iter const last, ptrdiff_t minRun, compare const cmp) {
+            for (Iter it = chunk.first; it < chunk.last;) {
+                Iter tmp = it;
+                it = ascending_end(tmp, chunk.last, cmp);
+                bool descending = it < chunk.last && !cmp(tmp[0], it[-1]);
+                if (descending) {
+                    it = descending_end(it, chunk.last, cmp);
+                }
+                chunk.runs.push_back(Candidate{tmp, it, descending, it == chunk.last && it != last});
+                it = std::max(it, tmp + std::min(minRun, last - tmp));
+            }
+        }
+
+        // First q >= it at which a run ascending (or descending) under cmp
+        // breaks, given that it does not break before it. Where the scan
+        // reaches a chunk whose first run goes the same way, that run's end
+        // is taken instead of scanning the chunk again.
+        Iter run_end(std::vector<Chunk> const &chunks, Iter it, Iter const last, bool descending, compare const cmp) {
+            auto stop = [&](Iter q) { return descending ? cmp(q[-1], q[0]) : cmp(q[0], q[-1]); };
+            while (it < last) {
+                auto chunk = std::upper_bound(chunks.begin(), chunks.end(), it,
+                                              [](Iter const &q, Chunk const &c) { return q < c.first; }) - 1;
+                if (it == chunk->first) {
+                    if (stop(it)) {
+                        return it;
+                    }
+                    Candidate const &head = chunk->runs.front();
+                    if (head.descending == descending) {
+                        it = head.last;
+                        if (!head.open) {
+                            return it;
+                        }
+                        continue;
+                    }
+                }
+                Iter q = descending ? descending_end(it - 1, chunk->last, cmp)
+                                    : ascending_end(it - 1, chunk->last, cmp);
+                if (q < chunk->last) {
+                    return q;
+                }
+                it = q;
+            }
+            return last;
+        }
+
+        // Splits [first, last) into runs, sorting short ones up to minRun on
+        // the pool. Under Powersort the merge tree is built as runs are found.
+        // Large inputs are cut into one chunk per thread and the chunks are
+        // scanned concurrently; a serial walk then stitches the true runs
+        // together from the chunks' runs, which agree with the serial scan
+        // wherever a true run starts where a chunk's run does. Runs that
+        // cross a chunk boundary continue through the next chunk's first run.
         void get_run(Container &left,
                      Iter const first,
                      Iter const last,
-                     Cmp const cmp) {
-            ptrdiff_t minRun = (last - first + 8) / 9;
+                     compare const cmp,
+                     Schedule &schedule) {
+            ptrdiff_t len = last - first;
+            ptrdiff_t minRun = (len + 8) / 9;
+            ptrdiff_t parts = len < PARALLEL_SCAN_THRESHOLDS ? 1 : (ptrdiff_t) pool.size() + 1;
+            std::vector<Chunk> chunks(parts);
+            for (ptrdiff_t t = 0; t < parts; ++t) {
+                chunks[t].first = first + len * t / parts;
+                chunks[t].last = first + len * (t + 1) / parts;
+            }
+            parallel_for(pool, parts, [&](ptrdiff_t t) { scan_chunk(chunks[t], last, minRun, cmp); }, counters);
+
+            std::vector<Pending> stack;
+            Run top;
+            size_t c = 0;
             for (Iter it = first; it < last;) {
                 Iter tmp = it;
-                while (it + 1 < last && is_equal(it[0], it[1], cmp)) {
-                    it += 1;
+                while (c + 1 < chunks.size() && chunks[c + 1].first <= tmp) {
+                    ++c;
                 }
-                if (it + 1 < last && cmp(it[1], it[0])) {
-                    do {
-                        ++it;
-                    } while (it < last && !cmp(it[-1], it[0]));
-                    reverse_stable(tmp, it, cmp);
+                Chunk &chunk = chunks[c];
+                while (chunk.next < chunk.runs.size() && chunk.runs[chunk.next].first < tmp) {
+                    ++chunk.next;
+                }
+                Candidate const *known = chunk.next < chunk.runs.size() && chunk.runs[chunk.next].first == tmp
+                                         ? &chunk.runs[chunk.next] : nullptr;
+                bool descending;
+                if (known && !known->open) {
+                    it = known->last;
+                    descending = known->descending;
+                } else if (known && known->descending) {
+                    it = run_end(chunks, known->last, last, true, cmp);
+                    descending = true;
                 } else {
-                    do {
-                        ++it;
-                    } while (it < last && !cmp(it[0], it[-1]));
+                    // One pass finds the ascending run. When it stops on a key
+                    // that is less than a block of equal keys, the block starts a
+                    // descending run instead, and the scan carries on from there.
+                    it = run_end(chunks, known ? known->last : tmp + 1, last, false, cmp);
+                    descending = it < last && !cmp(tmp[0], it[-1]);
+                    if (descending) {
+                        it = run_end(chunks, it + 1, last, true, cmp);
+                    }
                 }
+                Iter end = it;
+                counters.count_run(end - tmp);
                 if (it - tmp < minRun) {
                     it = std::min(tmp + minRun, last);
-                    pool.add([=] { my::merge_sort(tmp, it, cmp); });
+                    pointer buf = slice(tmp);
+                    pool.post([=] {
+                        if (descending) {
+                            reverse_stable(tmp, end, cmp);
+                        }
+                        sort_task(tmp, it, cmp, buf);
+                    });
+                } else if (descending) {
+                    pool.post([=] { reverse_stable(tmp, end, cmp); });
+                }
+                if (policy == merge_policy::powersort && !left.empty()) {
+                    power_push(stack, top, Run{tmp, it}, len, schedule);
+                } else {
+                    top = Run{tmp, it};
                 }
                 left.push_back(Run{tmp, it});
             }
-            pool.wait();
+            while (!stack.empty()) {
+                top = join(schedule, stack.back().run, top);
+                stack.pop_back();
+            }
+            counters.wait(pool);
         }
 
-        void merge_run(Container &left, Container &right, Cmp const cmp) {
+        // Splits the output of one merge into balanced segments by co-ranking,
+        // merges every segment into a shared buffer on the pool, then moves
+        // the result back. Equal keys keep the left run first.
+        void parallel_merge(Iter first, Iter div, Iter last, compare const cmp) {
+            pointer ptr = slice(first);
+            if (!merge_bounds(first, div, last, cmp)) {
+                return;
+            }
+            ptrdiff_t len = last - first;
+            ptrdiff_t na = div - first;
+            ptrdiff_t nb = last - div;
+            ptrdiff_t parts = (ptrdiff_t) pool.size() + 1;
+            if (len < merge_threshold || parts < 2 || shift != 0) {
+                merge_task(first, div, last, cmp, ptr);
+                return;
+            }
+            counters.count_moves(2 * len);
+            std::vector<ptrdiff_t> split(parts + 1);
+            for (ptrdiff_t n = 0; n <= parts; ++n) {
+                split[n] = co_rank(len * n / parts, first, na, div, nb, cmp);
+            }
+            parallel_for(pool, parts, [&](ptrdiff_t n) {
+                ptrdiff_t k0 = len * n / parts, k1 = len * (n + 1) / parts;
+                ptrdiff_t i0 = split[n], i1 = split[n + 1];
+                merge_into(first + i0, first + i1,
+                           div + (k0 - i0), div + (k1 - i1), ptr + k0, cmp);
+            }, counters);
+            parallel_for(pool, parts, [&](ptrdiff_t n) {
+                ptrdiff_t k0 = len * n / parts, k1 = len * (n + 1) / parts;
+                move_assign(ptr + k0, ptr + k1, first + k0);
+                destroy(ptr + k0, ptr + k1);
+            }, counters);
+        }
+
+        // Merges the k adjacent runs at `run` into the arena, cut by
+        // multi-sequence selection into one piece per thread when long, and
+        // moves the result back. The arena must hold the whole range.
+        void multiway_pass(Run const *run, size_t k, compare const cmp) {
+            Iter first = run[0].first;
+            ptrdiff_t len = run[k - 1].last - first;
+            pointer ptr = arena.data<value_type>() + (first - origin);
+            ptrdiff_t parts = len < merge_threshold ? 1 : (ptrdiff_t) pool.size() + 1;
+            counters.count_moves(2 * len);
+            // Row t holds the cuts at output position len * t / parts.
+            std::vector<Iter> split((parts + 1) * k);
+            for (size_t i = 0; i < k; ++i) {
+                split[i] = run[i].first;
+                split[parts * k + i] = run[i].last;
+            }
+            Iter const *lo = split.data();
+            Iter const *hi = split.data() + parts * k;
+            // Rows 0 and parts are the runs' own bounds.
+            parallel_for(pool, parts - 1, [&](ptrdiff_t t) {
+                multiway_split(len * (t + 1) / parts, lo, hi, k, &split[(t + 1) * k], cmp);
+            }, counters);
+            parallel_for(pool, parts, [&](ptrdiff_t t) {
+                my::multiway_merge(&split[t * k], &split[(t + 1) * k], k, ptr + len * t / parts, cmp);
+            }, counters);
+            parallel_for(pool, parts, [&](ptrdiff_t t) {
+                ptrdiff_t k0 = len * t / parts, k1 = len * (t + 1) / parts;
+                move_assign(ptr + k0, ptr + k1, first + k0);
+                destroy(ptr + k0, ptr + k1);
+            }, counters);
+        }
+
+        void multiway_merge(Container &runs, compare const cmp) {
+            // Neighbours already in order are one run.
+            Container next;
+            for (Run const &ref : runs) {
+                if (!next.empty() && !cmp(ref.first[0], next.back().last[-1])) {
+                    next.back().last = ref.last;
+                } else {
+                    next.push_back(ref);
+                }
+            }
+            runs.swap(next);
+            arena.reserve(sizeof(value_type) * ((runs.back().last - origin) + 1));
+            while (runs.size() > 1) {
+                next.clear();
+                ptrdiff_t merges = 0;
+                ptrdiff_t elements = 0;
+                for (size_t i = 0; i < runs.size(); i += MULTIWAY_WAYS) {
+                    size_t k = std::min(MULTIWAY_WAYS, runs.size() - i);
+                    if (k > 1) {
+                        multiway_pass(&runs[i], k, cmp);
+                        ++merges;
+                        elements += runs[i + k - 1].last - runs[i].first;
+                    }
+                    next.push_back(Run{runs[i].first, runs[i + k - 1].last});
+                }
+                counters.count_pass(merges, sizeof(value_type) * elements);
+                runs.swap(next);
+            }
+        }
+
+        Run join(Schedule &schedule, Run const &run_a, Run const &run_b) {
+            size_t depth = std::max(run_a.depth, run_b.depth) + 1;
+            schedule.push_back(Merge{run_a.first, run_a.last, run_b.last, depth});
+            return Run{run_a.first, run_b.last, depth};
+        }
+
+        // Merges of the same depth cover disjoint ranges, so each level runs
+        // concurrently on the pool and the next level waits on a barrier.
+        void run_schedule(Schedule &schedule, compare const cmp) {
+            size_t depth = 0;
+            for (Merge const &ref : schedule) {
+                depth = std::max(depth, ref.depth);
+                merged += ref.last - ref.first;
+            }
+            for (size_t level = 1; level <= depth; ++level) {
+                if constexpr (Stats::enabled) {
+                    ptrdiff_t merges = 0;
+                    ptrdiff_t elements = 0;
+                    for (Merge const &ref : schedule) {
+                        if (ref.depth == level) {
+                            ++merges;
+                            elements += ref.last - ref.first;
+                        }
+                    }
+                    counters.count_pass(merges, sizeof(value_type) * elements);
+                }
+                Merge const *solo = nullptr;
+                size_t count = 0;
+                for (Merge const &ref : schedule) {
+                    if (ref.depth != level || ref.last - ref.first >= merge_threshold) {
+                        continue;
+                    }
+                    if (count++ != 0) {
+                        pointer buf = slice(ref.first);
+                        pool.post([=] { merge_task(ref.first, ref.div, ref.last, cmp, buf); });
+                    } else {
+                        solo = &ref;
+                    }
+                }
+                // Large merges are split across the pool from this thread.
+                for (Merge const &ref : schedule) {
+                    if (ref.depth == level && ref.last - ref.first >= merge_threshold) {
+                        parallel_merge(ref.first, ref.div, ref.last, cmp);
+                    }
+                }
+                if (solo != nullptr) {
+                    merge_task(solo->first, solo->div, solo->last, cmp, slice(solo->first));
+                }
+                counters.wait(pool);
+            }
+            schedule.clear();
+        }
+
+        void merge_run(Container &left, Container &right, compare const cmp) {
             ptrdiff_t len = left.back().last - left.front().first;
             ptrdiff_t mean = len / left.size();
+            Schedule schedule;
             auto pull_back = [&](Run &ref) {
                 ref = left.back();
                 left.pop_back();
             };
-            // println(left.size());
             while (!left.empty()) {
                 Run run_a, run_b, run_c;
                 ptrdiff_t a, b, c;
@@ -233,11 +1303,9 @@ namespace my {
                             left.push_back(run_b);
                         } else {
                             if (run_a.last == run_b.first) {
-                                merge(run_a.first, run_a.last, run_b.last, cmp);
-                                left.push_back(Run{run_a.first, run_b.last});
+                                left.push_back(join(schedule, run_a, run_b));
                             } else if (run_b.last == run_a.first) {
-                                merge(run_b.first, run_b.last, run_a.last, cmp);
-                                left.push_back(Run{run_b.first, run_a.last});
+                                left.push_back(join(schedule, run_b, run_a));
                             }
                         }
                         break;
@@ -246,11 +1314,9 @@ namespace my {
                         pull_back(run_b);
 
                         if (run_a.last == run_b.first) {
-                            merge(run_a.first, run_a.last, run_b.last, cmp);
-                            right.push_back(Run{run_a.first, run_b.last});
+                            right.push_back(join(schedule, run_a, run_b));
                         } else if (run_b.last == run_a.first) {
-                            merge(run_b.first, run_b.last, run_a.last, cmp);
-                            right.push_back(Run{run_b.first, run_a.last});
+                            right.push_back(join(schedule, run_b, run_a));
                         }
                         break;
                     case 1:
@@ -262,24 +1328,206 @@ namespace my {
                         break;
                 }
             }
+            run_schedule(schedule, cmp);
+            for (Run &ref : right) {
+                ref.depth = 0;
+            }
         }
 
-    public:
-        void sort(Iter const first, Iter const last, Cmp const cmp = {}) {
+        void sort_by(sort_strategy on, Iter const first, Iter const last, Cmp const user) {
+            compare const cmp = counting(user);
+            switch (on) {
+                case sort_strategy::radix:
+                    if constexpr (use_radix_v<value_type, Cmp> && is_contiguous_iterator_v<Iter>) {
+                        counters.start(sort_phase::radix);
+                        arena.reserve(sizeof(value_type) * (last - first));
+                        radix_sort(first, last, user, arena.data<value_type>(), pool);
+                        counters.stop(sort_phase::radix);
+                    }
+                    return;
+                case sort_strategy::strings:
+                    if constexpr (use_string_sort_v<value_type, Cmp>) {
+                        counters.start(sort_phase::strings);
+                        sort_strings(first, last);
+                        counters.stop(sort_phase::strings);
+                    }
+                    return;
+                case sort_strategy::sample:
+                case sort_strategy::few_unique:
+                    counters.start(sort_phase::sample);
+                    sort_sample(first, last, cmp);
+                    counters.stop(sort_phase::sample);
+                    return;
+                default:
+                    break;
+            }
             Container left;
             Container right;
-            get_run(left, first, last, cmp);
-            while (true) {
-                if (left.size() > 1) {
-                    merge_run(left, right, cmp);
-                } else {
-                    break;
+            Schedule schedule;
+            reserve(first, last);
+            counters.start(sort_phase::runs);
+            get_run(left, first, last, cmp, schedule);
+            counters.stop(sort_phase::runs);
+            counters.start(sort_phase::merge);
+            if (multiway && left.size() >= MULTIWAY_MIN_RUNS && fits(last - first + 1)) {
+                multiway_merge(left, cmp);
+            } else if (policy == merge_policy::powersort) {
+                run_schedule(schedule, cmp);
+            } else {
+                while (true) {
+                    if (left.size() > 1) {
+                        merge_run(left, right, cmp);
+                    } else {
+                        break;
+                    }
+                    if (right.size() > 1) {
+                        merge_run(right, left, cmp);
+                    } else {
+                        break;
+                    }
                 }
-                if (right.size() > 1) {
-                    merge_run(right, left, cmp);
-                } else {
-                    break;
+            }
+            counters.stop(sort_phase::merge);
+        }
+
+    public:
+        void sort(Iter const first, Iter const last, Cmp const cmp = {}) {
+            saved = 0;
+            merged = 0;
+            counters.reset();
+            chosen = choose_strategy(first, last, cmp);
+            sort_by(chosen, first, last, cmp);
+            counters.count_scratch(arena.capacity());
+        }
+
+        // Sorts by cmp(proj(a), proj(b)), like std::ranges::sort: cmp orders
+        // the keys, whatever their type, and is independent of Cmp.
+        template<class KeyCmp = std::less<>, class Proj>
+        void sort(Iter const first, Iter const last, KeyCmp const cmp, Proj const proj) {
+            if (key_cache) {
+                sort_cached(first, last, cmp, proj);
+                return;
+            }
+            timsort<Iter, projected_cmp<KeyCmp, Proj>, Stats> tim(pool);
+            configure(tim, sizeof(value_type) * ((last - first) + 1));
+            tim.sort(first, last, {cmp, proj});
+            counters.reset();
+            take_results(tim);
+        }
+
+    private:
+        // Hands a nested sorter (the projected and key cache sorts run one)
+        // every setting of this one, and this arena as its scratch when
+        // `bytes` of it fit the budget.
+        template<class Other>
+        void configure(Other &tim, size_t bytes) {
+            tim.set_memory_budget(budget);
+            if (bytes <= budget) {
+                arena.reserve(bytes);
+                tim.use_buffer(arena.data<void>(), arena.capacity());
+            }
+            tim.use_huge_pages(arena.huge_pages());
+            tim.set_parallel_merge_threshold(merge_threshold);
+            tim.use_merge_policy(policy);
+            tim.use_radix(radix);
+            tim.use_key_cache(key_cache);
+            tim.use_string_mode(strings);
+            tim.use_sample_sort(sample);
+            tim.use_multiway(multiway);
+            tim.use_strategy(strategy);
+            if constexpr (Stats::enabled) {
+                tim.counters.use_perf(counters.uses_perf());
+            }
+        }
+
+        // What the nested sorter did becomes what this one's last sort did.
+        template<class Other>
+        void take_results(Other const &tim) {
+            saved = tim.comparisons_saved();
+            merged = tim.elements_merged();
+            chosen = tim.last_strategy();
+            estimate = tim.last_presortedness();
+            counters.absorb(tim.counters);
+        }
+
+        template<class KeyCmp, class Proj>
+        void sort_cached(Iter const first, Iter const last, KeyCmp const cmp, Proj const proj) {
+            using key_type = std::decay_t<std::invoke_result_t<Proj const &, reference>>;
+            using item = keyed<key_type, size_t>;
+            ptrdiff_t len = last - first;
+            counters.reset();
+            counters.start(sort_phase::keys);
+            std::vector<item> keys(len);
+            counters.count_scratch(sizeof(item) * len);
+            ptrdiff_t parts = len < merge_threshold ? 1 : (ptrdiff_t) pool.size() + 1;
+            auto extract = [&](ptrdiff_t t) {
+                for (ptrdiff_t n = len * t / parts; n < len * (t + 1) / parts; ++n) {
+                    keys[n].key = std::invoke(proj, first[n]);
+                    keys[n].index = n;
+                }
+            };
+            parallel_for(pool, parts, extract, counters);
+            counters.stop(sort_phase::keys);
+
+            timsort<typename std::vector<item>::iterator, keyed_cmp<KeyCmp>, Stats> tim(pool);
+            configure(tim, sizeof(item) * (len + 1));
+            tim.sort(keys.begin(), keys.end(), {cmp});
+            take_results(tim);
+
+            counters.start(sort_phase::keys);
+            permute(first, keys);
+            counters.stop(sort_phase::keys);
+        }
+
+        void sort_sample(Iter const first, Iter const last, compare const cmp) {
+            arena.reserve(sizeof(value_type) * (last - first));
+            sample_sort(first, last, cmp, arena.data<value_type>(), pool, [&](Iter a, Iter b, pointer buf) {
+                gallop_state state;
+                merge_sort(a, b, cmp, buf, state);
+                saved += state.saved;
+                counters.count_moves(state.moved);
+            });
+        }
+
+        // Sorts strings through string_items: the prefix cache and the LCPs
+        // the merges carry spare most byte comparisons, and only the items
+        // move until the final permutation.
+        void sort_strings(Iter const first, Iter const last) {
+            ptrdiff_t len = last - first;
+            std::vector<string_item> items(len);
+            counters.count_scratch(sizeof(string_item) * len);
+            ptrdiff_t parts = len < merge_threshold ? 1 : (ptrdiff_t) pool.size() + 1;
+            auto extract = [&](ptrdiff_t t) {
+                for (ptrdiff_t n = len * t / parts; n < len * (t + 1) / parts; ++n) {
+                    items[n] = make_string_item(std::string_view(first[n]), n);
+                }
+            };
+            parallel_for(pool, parts, extract, counters);
+
+            arena.reserve(sizeof(string_item) * len);
+            lcp_merge_sort(items.data(), items.data() + len, arena.data<string_item>(), pool);
+            permute(first, items);
+        }
+
+        // keys[n].index is where the element that belongs at n is now.
+        // Follow each cycle once, marking placed slots with index == n.
+        template<class Keys>
+        static void permute(Iter const first, Keys &keys) {
+            ptrdiff_t len = keys.size();
+            for (ptrdiff_t n = 0; n < len; ++n) {
+                if ((ptrdiff_t) keys[n].index == n) {
+                    continue;
+                }
+                value_type tmp = std::move(first[n]);
+                ptrdiff_t pos = n;
+                while ((ptrdiff_t) keys[pos].index != n) {
+                    ptrdiff_t next = keys[pos].index;
+                    first[pos] = std::move(first[next]);
+                    keys[pos].index = pos;
+                    pos = next;
                 }
+                first[pos] = std::move(tmp);
+                keys[pos].index = pos;
             }
         }
     };
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <functional>
 #include <type_traits>
+#include <vector>
 
 namespace my {
 
@@ -13,4 +15,46 @@ namespace my {
     template<class F, class... ArgTypes>
     using invoke_result_t = typename invoke_result<F, ArgTypes...>::type;
 
+    // Whether `Cmp` is std::less / std::greater over `Ty`, including the
+    // transparent std::less<> / std::greater<>.
+    template<class Ty, class Cmp>
+    class is_less : public std::false_type {
+    };
+
+    template<class Ty>
+    class is_less<Ty, std::less<Ty>> : public std::true_type {
+    };
+
+    template<class Ty>
+    class is_less<Ty, std::less<>> : public std::true_type {
+    };
+
+    template<class Ty, class Cmp>
+    class is_greater : public std::false_type {
+    };
+
+    template<class Ty>
+    class is_greater<Ty, std::greater<Ty>> : public std::true_type {
+    };
+
+    template<class Ty>
+    class is_greater<Ty, std::greater<>> : public std::true_type {
+    };
+
+    template<class Ty, class Cmp>
+    constexpr bool is_standard_order_v = is_less<Ty, Cmp>::value || is_greater<Ty, Cmp>::value;
+
+    // Iterators whose elements are known to sit in one contiguous block, so
+    // std::addressof(*it) can be used as a pointer into the whole range.
+    template<class Iter, class Ty = typename std::iterator_traits<Iter>::value_type>
+    class is_contiguous_iterator : public std::integral_constant<bool,
+            std::is_pointer<Iter>::value
+            || (!std::is_same<Ty, bool>::value
+                && (std::is_same<Iter, typename std::vector<Ty>::iterator>::value
+                    || std::is_same<Iter, typename std::vector<Ty>::const_iterator>::value))> {
+    };
+
+    template<class Iter>
+    constexpr bool is_contiguous_iterator_v = is_contiguous_iterator<Iter>::value;
+
 } // namespace my
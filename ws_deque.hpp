@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace my {
+
+    // Chase-Lev work-stealing deque. One owner pushes and pops at the bottom
+    // without locking; any number of thieves take from the top with a CAS.
+    // The circular storage doubles when full. Old rings are kept until the
+    // deque dies because a thief may still be reading one.
+    template<class Ty>
+    class ws_deque {
+        static_assert(std::is_trivially_copyable<Ty>::value, "ws_deque slots are read racily");
+
+        class ring {
+            int64_t mask;
+            std::unique_ptr<std::atomic<Ty>[]> slot;
+
+        public:
+            explicit ring(int64_t n) : mask(n - 1), slot(new std::atomic<Ty>[n]) {
+            }
+
+            int64_t capacity() const {
+                return mask + 1;
+            }
+
+            Ty get(int64_t i) const {
+                return slot[i & mask].load(std::memory_order_relaxed);
+            }
+
+            void put(int64_t i, Ty value) {
+                slot[i & mask].store(value, std::memory_order_relaxed);
+            }
+
+            ring *grow(int64_t top, int64_t bottom) const {
+                auto ptr = new ring(capacity() << 1);
+                for (int64_t i = top; i < bottom; ++i) {
+                    ptr->put(i, get(i));
+                }
+                return ptr;
+            }
+        };
+
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::atomic<ring *> array;
+        std::vector<std::unique_ptr<ring>> rings;
+
+    public:
+        explicit ws_deque(int64_t n = 64) {
+            int64_t cap = 1;
+            while (cap < n) {
+                cap <<= 1;
+            }
+            rings.emplace_back(new ring(cap));
+            array.store(rings.back().get(), std::memory_order_relaxed);
+        }
+
+        ws_deque(ws_deque const &) = delete;
+
+        ws_deque &operator=(ws_deque const &) = delete;
+
+        // Approximate; exact only when called by the owner with no thieves.
+        size_t size() const {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_relaxed);
+            return b > t ? size_t(b - t) : 0;
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        // Owner only.
+        void push(Ty value) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            ring *ptr = array.load(std::memory_order_relaxed);
+            if (b - t >= ptr->capacity()) {
+                ptr = ptr->grow(t, b);
+                rings.emplace_back(ptr);
+                array.store(ptr, std::memory_order_release);
+            }
+            ptr->put(b, value);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // Owner only: takes the most recently pushed element.
+        bool pop(Ty &ref) {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            ring *ptr = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+            ref = ptr->get(b);
+            if (t == b) {
+                // Last element: race the thieves for it.
+                bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                       std::memory_order_relaxed);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+
+        // Any thread: takes the oldest element.
+        bool steal(Ty &ref) {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return false;
+            }
+            ring *ptr = array.load(std::memory_order_acquire);
+            Ty value = ptr->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed)) {
+                return false;
+            }
+            ref = value;
+            return true;
+        }
+    };
+
+} // namespace my